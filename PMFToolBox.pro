@@ -38,15 +38,20 @@ DEFINES += QT_DISABLE_DEPRECATED_BEFORE=0x060000    # disables all the APIs depr
 SOURCES += \
     aboutdialog/aboutdialog.cpp \
     base/cliobject.cpp \
+    base/dynamicpath.cpp \
     base/graph.cpp \
     base/helper.cpp \
     base/histogram.cpp \
+    base/histogramwriter.cpp \
     base/historyfile.cpp \
     base/integrate_gradients.cpp \
+    base/mergetree.cpp \
     base/metadynamics.cpp \
     base/pathfinderthread.cpp \
     base/plot.cpp \
     base/reweighting.cpp \
+    base/stringmethod.cpp \
+    base/threadpool.cpp \
     findpathtab/addpatchdialog.cpp \
     findpathtab/findpathtab.cpp \
     findpathtab/patchtablemodel.cpp \
@@ -68,15 +73,20 @@ HEADERS += \
     aboutdialog/aboutdialog.h \
     base/cliobject.h \
     base/common.h \
+    base/dynamicpath.h \
     base/graph.h \
     base/helper.h \
     base/histogram.h \
+    base/histogramwriter.h \
     base/historyfile.h \
     base/integrate_gradients.h \
+    base/mergetree.h \
     base/metadynamics.h \
     base/pathfinderthread.h \
     base/plot.h \
     base/reweighting.h \
+    base/stringmethod.h \
+    base/threadpool.h \
     base/turbocolormap.h \
     findpathtab/addpatchdialog.h \
     findpathtab/findpathtab.h \
@@ -0,0 +1,188 @@
+/*
+  PMFToolBox: A toolbox to analyze and post-process the output of
+  potential of mean force calculations.
+  Copyright (C) 2020  Haochuan Chen
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU Affero General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU Affero General Public License for more details.
+
+  You should have received a copy of the GNU Affero General Public License
+  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "dynamicpath.h"
+
+#include <QDebug>
+#include <QElapsedTimer>
+#include <algorithm>
+#include <limits>
+
+namespace {
+const LifelongPlanningAStar::Distance distance_infinity(
+    std::numeric_limits<double>::infinity(),
+    std::numeric_limits<size_t>::max());
+} // namespace
+
+LifelongPlanningAStar::LifelongPlanningAStar()
+    : mInitialized(false), mNumNodes(0), mStart(0), mEnd(0),
+      mMode(Graph::FindPathMode::SumOfEdges) {}
+
+LifelongPlanningAStar::LifelongPlanningAStar(const Graph &graph, size_t start,
+                                             size_t end,
+                                             Graph::FindPathMode mode)
+    : mInitialized(true), mNumNodes(graph.numNodes()), mStart(start),
+      mEnd(end), mMode(mode), mSuccessors(mNumNodes),
+      mPredecessors(mNumNodes) {
+  qDebug() << "Calling" << Q_FUNC_INFO;
+  for (size_t i = 0; i < mNumNodes; ++i) {
+    graph.forEachNeighbor(i, [&](const Graph::Node &neighbor) {
+      mSuccessors[i].push_back(neighbor);
+      mPredecessors[neighbor.mIndex].push_back(
+          Graph::Node{i, neighbor.mWeight});
+    });
+  }
+  mG.assign(mNumNodes, distance_infinity);
+  mRHS.assign(mNumNodes, distance_infinity);
+  mQueueKey.assign(mNumNodes, distance_infinity);
+  mInQueue.assign(mNumNodes, false);
+  mVisited.assign(mNumNodes, false);
+  mRHS[mStart] = Distance((mMode == Graph::FindPathMode::MaximumEdges)
+                              ? std::numeric_limits<double>::lowest()
+                              : 0,
+                          0);
+  updateVertex(mStart);
+}
+
+bool LifelongPlanningAStar::initialized() const { return mInitialized; }
+
+size_t LifelongPlanningAStar::start() const { return mStart; }
+
+size_t LifelongPlanningAStar::end() const { return mEnd; }
+
+Graph::FindPathMode LifelongPlanningAStar::mode() const { return mMode; }
+
+void LifelongPlanningAStar::setEdgeWeight(size_t source, size_t destination,
+                                          double weight) {
+  for (auto &node : mSuccessors[source]) {
+    if (node.mIndex == destination)
+      node.mWeight = weight;
+  }
+  for (auto &node : mPredecessors[destination]) {
+    if (node.mIndex == source)
+      node.mWeight = weight;
+  }
+  updateVertex(destination);
+}
+
+void LifelongPlanningAStar::setIncomingWeight(size_t destination,
+                                              double weight) {
+  for (auto &node : mPredecessors[destination]) {
+    node.mWeight = weight;
+    for (auto &successor : mSuccessors[node.mIndex]) {
+      if (successor.mIndex == destination)
+        successor.mWeight = weight;
+    }
+  }
+  updateVertex(destination);
+}
+
+LifelongPlanningAStar::Distance
+LifelongPlanningAStar::combine(const Distance &distance, double weight) const {
+  if (distance == distance_infinity)
+    return distance_infinity;
+  if (mMode == Graph::FindPathMode::MaximumEdges) {
+    return Distance(std::max(distance.first, weight), distance.second + 1);
+  } else {
+    return Distance(distance.first + weight, distance.second + 1);
+  }
+}
+
+void LifelongPlanningAStar::updateVertex(size_t u) {
+  if (u != mStart) {
+    Distance rhs = distance_infinity;
+    for (const auto &node : mPredecessors[u]) {
+      rhs = std::min(rhs, combine(mG[node.mIndex], node.mWeight));
+    }
+    mRHS[u] = rhs;
+  }
+  if (mInQueue[u]) {
+    mQueue.erase(std::make_pair(mQueueKey[u], u));
+    mInQueue[u] = false;
+  }
+  if (mG[u] != mRHS[u]) {
+    mQueueKey[u] = std::min(mG[u], mRHS[u]);
+    mQueue.insert(std::make_pair(mQueueKey[u], u));
+    mInQueue[u] = true;
+  }
+}
+
+Graph::FindPathResult LifelongPlanningAStar::computeShortestPath() {
+  qDebug() << "Calling" << Q_FUNC_INFO;
+  if (!mInitialized)
+    return Graph::FindPathResult();
+  QElapsedTimer timer;
+  timer.start();
+  size_t loop = 0;
+  while (!mQueue.empty() &&
+         (mQueue.begin()->first < std::min(mG[mEnd], mRHS[mEnd]) ||
+          mG[mEnd] != mRHS[mEnd])) {
+    const size_t u = mQueue.begin()->second;
+    mQueue.erase(mQueue.begin());
+    mInQueue[u] = false;
+    if (mG[u] > mRHS[u]) {
+      // overconsistent: the distance decreases
+      mG[u] = mRHS[u];
+      mVisited[u] = true;
+    } else {
+      // underconsistent: the distance increases, so recompute it
+      mG[u] = distance_infinity;
+      updateVertex(u);
+    }
+    for (const auto &node : mSuccessors[u]) {
+      updateVertex(node.mIndex);
+    }
+    ++loop;
+  }
+  qDebug() << "LPA* search takes" << timer.elapsed()
+           << "milliseconds; total number of loops:" << loop;
+  std::vector<double> res_distance(mNumNodes);
+  for (size_t i = 0; i < mNumNodes; ++i) {
+    res_distance[i] = mG[i].first;
+  }
+  Graph::FindPathResult result{loop, mVisited, tracePath(), res_distance};
+  return result;
+}
+
+std::vector<size_t> LifelongPlanningAStar::tracePath() const {
+  std::vector<size_t> path;
+  if (mG[mEnd] == distance_infinity)
+    return path;
+  // walk back along the predecessors that give the distance, where the
+  // number of steps decreases by one in each step
+  size_t target = mEnd;
+  path.push_back(target);
+  while (target != mStart) {
+    size_t best = mNumNodes;
+    for (const auto &node : mPredecessors[target]) {
+      if (combine(mG[node.mIndex], node.mWeight) == mG[target]) {
+        best = node.mIndex;
+        break;
+      }
+    }
+    if (best == mNumNodes) {
+      qWarning() << "Failed to trace the path back to the start.";
+      return std::vector<size_t>();
+    }
+    target = best;
+    path.push_back(target);
+  }
+  std::reverse(path.begin(), path.end());
+  return path;
+}
@@ -0,0 +1,76 @@
+/*
+  PMFToolBox: A toolbox to analyze and post-process the output of
+  potential of mean force calculations.
+  Copyright (C) 2020  Haochuan Chen
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU Affero General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU Affero General Public License for more details.
+
+  You should have received a copy of the GNU Affero General Public License
+  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef DYNAMICPATH_H
+#define DYNAMICPATH_H
+
+#include "base/graph.h"
+
+#include <cstddef>
+#include <set>
+#include <utility>
+#include <vector>
+
+// Lifelong planning A* (LPA*) without a heuristic. The distances from the
+// start are kept after a search, so after changing some edge weights only
+// the vertices whose distances are affected are searched again to repair
+// the shortest path. The distances are combined by the sum (SumOfEdges) or
+// the maximum (MaximumEdges) of the edge weights. The number of steps breaks
+// the ties of the distances, so that zero-weight edges (or plateaus in the
+// MaximumEdges mode) do not form cycles of equal distances.
+class LifelongPlanningAStar {
+public:
+  // the combined weights and the number of steps
+  typedef std::pair<double, size_t> Distance;
+  LifelongPlanningAStar();
+  LifelongPlanningAStar(const Graph &graph, size_t start, size_t end,
+                        Graph::FindPathMode mode);
+  bool initialized() const;
+  size_t start() const;
+  size_t end() const;
+  Graph::FindPathMode mode() const;
+  void setEdgeWeight(size_t source, size_t destination, double weight);
+  // set the weights of all edges pointing to the destination
+  void setIncomingWeight(size_t destination, double weight);
+  // search (or repair) the shortest path, and return an empty path if the
+  // end is not reachable
+  Graph::FindPathResult computeShortestPath();
+
+private:
+  Distance combine(const Distance &distance, double weight) const;
+  void updateVertex(size_t u);
+  std::vector<size_t> tracePath() const;
+  bool mInitialized;
+  size_t mNumNodes;
+  size_t mStart;
+  size_t mEnd;
+  Graph::FindPathMode mMode;
+  std::vector<std::vector<Graph::Node>> mSuccessors;
+  std::vector<std::vector<Graph::Node>> mPredecessors;
+  // g is the distance of the last expansion and rhs is the one-step
+  // lookahead from the predecessors; a vertex is in the queue if they differ
+  std::vector<Distance> mG;
+  std::vector<Distance> mRHS;
+  std::set<std::pair<Distance, size_t>> mQueue;
+  std::vector<Distance> mQueueKey;
+  std::vector<bool> mInQueue;
+  std::vector<bool> mVisited;
+};
+
+#endif // DYNAMICPATH_H
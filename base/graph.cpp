@@ -18,6 +18,12 @@
 */
 
 #include "graph.h"
+#include "threadpool.h"
+
+#include <atomic>
+#include <iterator>
+#include <map>
+#include <set>
 
 Graph::Graph() : mNumNodes(0), mIsDirected(false), mHead(0) {}
 
@@ -103,6 +109,34 @@ void Graph::DFS(size_t start, std::function<void(const Node &)> func) const {
   DFSHelper(start, visited, func);
 }
 
+std::vector<bool> Graph::reachableFrom(size_t start) const {
+  std::vector<bool> reachable(mNumNodes, false);
+  if (start >= mNumNodes)
+    return reachable;
+  std::vector<size_t> stack{start};
+  reachable[start] = true;
+  while (!stack.empty()) {
+    const size_t i = stack.back();
+    stack.pop_back();
+    auto neighbor_node = std::next(mHead[i].cbegin(), 1);
+    while (neighbor_node != mHead[i].cend()) {
+      if (reachable[neighbor_node->mIndex] == false) {
+        reachable[neighbor_node->mIndex] = true;
+        stack.push_back(neighbor_node->mIndex);
+      }
+      std::advance(neighbor_node, 1);
+    }
+  }
+  return reachable;
+}
+
+size_t Graph::numNodes() const { return mNumNodes; }
+
+void Graph::forEachNeighbor(size_t i,
+                            std::function<void(const Node &)> func) const {
+  std::for_each(std::next(mHead[i].cbegin(), 1), mHead[i].cend(), func);
+}
+
 Graph::FindPathResult Graph::Dijkstra(size_t start, size_t end,
                                       Graph::FindPathMode mode) {
   switch (mode) {
@@ -116,7 +150,7 @@ Graph::FindPathResult Graph::Dijkstra(size_t start, size_t end,
   case Graph::FindPathMode::MaximumEdges: {
     const double dist_inf = std::numeric_limits<double>::max();
     return Dijkstra<double>(
-        start, end, findMaxSumWeight() + 1.0, dist_inf,
+        start, end, std::numeric_limits<double>::lowest(), dist_inf,
         [](const double &x, const double &y) { return std::max(x, y); });
     break;
   }
@@ -134,6 +168,321 @@ Graph::FindPathResult Graph::Dijkstra(size_t start, size_t end,
   }
 }
 
+Graph::FindPathResult
+Graph::MultiSourceDijkstra(const std::vector<size_t> &starts,
+                           const std::vector<size_t> &ends,
+                           Graph::FindPathMode mode) const {
+  switch (mode) {
+  case Graph::FindPathMode::SumOfEdges: {
+    const double dist_inf = std::numeric_limits<double>::max();
+    return MultiSourceDijkstra<double>(
+        starts, ends, 0, dist_inf,
+        [](const double &x, const double &y) { return x + y; });
+  }
+  case Graph::FindPathMode::MaximumEdges: {
+    const double dist_inf = std::numeric_limits<double>::max();
+    return MultiSourceDijkstra<double>(
+        starts, ends, std::numeric_limits<double>::lowest(), dist_inf,
+        [](const double &x, const double &y) { return std::max(x, y); });
+  }
+  case Graph::FindPathMode::MFEPMode: {
+    const MFEPDistance dist_start;
+    const MFEPDistance dist_inf({std::numeric_limits<double>::max()});
+    return MultiSourceDijkstra<MFEPDistance>(
+        starts, ends, dist_start, dist_inf,
+        [](const MFEPDistance &x, const double &weight) { return x + weight; });
+  }
+  default: {
+    return FindPathResult();
+  }
+  }
+}
+
+template <typename DistanceType>
+std::vector<Graph::FindPathResult> Graph::BatchDijkstra(
+    const std::vector<std::pair<size_t, size_t>> &queries,
+    const DistanceType &dist_start, const DistanceType &dist_infinity,
+    std::function<DistanceType(DistanceType, double)> calc_new_dist,
+    size_t numThreads) const {
+  qDebug() << "Calling" << Q_FUNC_INFO;
+  // group the queries by their starts
+  std::map<size_t, std::vector<size_t>> queries_by_start;
+  for (size_t i = 0; i < queries.size(); ++i) {
+    queries_by_start[queries[i].first].push_back(i);
+  }
+  const std::vector<std::pair<size_t, std::vector<size_t>>> sources(
+      queries_by_start.begin(), queries_by_start.end());
+  std::vector<FindPathResult> results(queries.size());
+  if (sources.empty())
+    return results;
+  numThreads = std::min(std::max(numThreads, size_t(1)), sources.size());
+  QElapsedTimer timer;
+  timer.start();
+  // the sources are taken one by one so that a slow source does not hold
+  // up the others, and the graph is only read by the workers
+  std::atomic<size_t> next_source(0);
+  ThreadPool pool(numThreads);
+  pool.run([&](size_t) {
+    std::vector<bool> visited;
+    std::vector<size_t> previous;
+    std::vector<DistanceType> distances;
+    size_t reached_end = mNumNodes;
+    size_t i;
+    while ((i = next_source.fetch_add(1)) < sources.size()) {
+      const size_t start = sources[i].first;
+      std::vector<size_t> ends;
+      for (const auto &j : sources[i].second) {
+        ends.push_back(queries[j].second);
+      }
+      const size_t loop =
+          DijkstraTree(std::vector<size_t>{start}, ends, false, dist_start,
+                       dist_infinity, calc_new_dist, visited, previous,
+                       distances, reached_end);
+      for (const auto &j : sources[i].second) {
+        const size_t end = queries[j].second;
+        std::vector<size_t> path;
+        if (visited[end] == true)
+          path = traceTree(previous, end);
+        // a copy of the visited vertices per query would cost as much as the
+        // searches on a large grid
+        results[j] = FindPathResult{loop, {}, path, {}};
+      }
+    }
+  });
+  qDebug() << "Batched Dijkstra's algorithm of" << queries.size()
+           << "queries from" << sources.size() << "starts takes"
+           << timer.elapsed() << "milliseconds with" << numThreads
+           << "threads.";
+  return results;
+}
+
+std::vector<Graph::FindPathResult>
+Graph::BatchDijkstra(const std::vector<std::pair<size_t, size_t>> &queries,
+                     Graph::FindPathMode mode, size_t numThreads) const {
+  switch (mode) {
+  case Graph::FindPathMode::SumOfEdges: {
+    const double dist_inf = std::numeric_limits<double>::max();
+    return BatchDijkstra<double>(
+        queries, 0, dist_inf,
+        [](const double &x, const double &y) { return x + y; }, numThreads);
+  }
+  case Graph::FindPathMode::MaximumEdges: {
+    const double dist_inf = std::numeric_limits<double>::max();
+    return BatchDijkstra<double>(
+        queries, std::numeric_limits<double>::lowest(), dist_inf,
+        [](const double &x, const double &y) { return std::max(x, y); },
+        numThreads);
+  }
+  case Graph::FindPathMode::MFEPMode: {
+    const MFEPDistance dist_start;
+    const MFEPDistance dist_inf({std::numeric_limits<double>::max()});
+    return BatchDijkstra<MFEPDistance>(
+        queries, dist_start, dist_inf,
+        [](const MFEPDistance &x, const double &weight) { return x + weight; },
+        numThreads);
+  }
+  default: {
+    return std::vector<FindPathResult>(queries.size());
+  }
+  }
+}
+
+template <typename DistanceType>
+std::vector<Graph::FindPathResult> Graph::KShortestPaths(
+    size_t start, size_t end, size_t k, const DistanceType &dist_start,
+    const DistanceType &dist_infinity,
+    std::function<DistanceType(DistanceType, double)> calc_new_dist,
+    double maxSharedFraction, size_t maxCandidates, size_t numThreads) const {
+  qDebug() << "Calling" << Q_FUNC_INFO;
+  std::vector<FindPathResult> results;
+  if (k == 0 || start >= mNumNodes || end >= mNumNodes)
+    return results;
+  QElapsedTimer timer;
+  timer.start();
+  // the shortest path tree towards the end is found by searching the
+  // reversed graph from the end, where previous[i] is the next vertex of i
+  Graph reversed(mNumNodes, true);
+  for (size_t i = 0; i < mNumNodes; ++i) {
+    forEachNeighbor(i, [&](const Node &node) {
+      reversed.setEdgeHelper(node.mIndex, i, node.mWeight);
+    });
+  }
+  std::vector<bool> tree_visited;
+  std::vector<size_t> next;
+  std::vector<DistanceType> tree_distances;
+  size_t tree_end = mNumNodes;
+  std::atomic<size_t> total_loops(reversed.DijkstraTree(
+      std::vector<size_t>{end}, std::vector<size_t>(), false, dist_start,
+      dist_infinity, calc_new_dist, tree_visited, next, tree_distances,
+      tree_end));
+  if (tree_visited[start] == false) {
+    qDebug() << "The end is not reachable from the start.";
+    return results;
+  }
+  auto pathCost = [&](const std::vector<size_t> &path) {
+    DistanceType distance = dist_start;
+    double weight = 0;
+    for (size_t i = 1; i < path.size(); ++i) {
+      getEdge(path[i - 1], path[i], weight);
+      distance = calc_new_dist(distance, weight);
+    }
+    return distance;
+  };
+  std::vector<size_t> first_path{start};
+  while (first_path.back() != end)
+    first_path.push_back(next[first_path.back()]);
+  // the paths whose deviations have been generated, and the candidate
+  // deviations
+  std::vector<std::vector<size_t>> expanded;
+  std::set<std::vector<size_t>> generated{first_path};
+  std::set<std::pair<DistanceType, std::vector<size_t>>> candidates;
+  candidates.insert(std::make_pair(pathCost(first_path), first_path));
+  std::vector<std::vector<size_t>> reported_vertices;
+  // with the diversity filter, the spur paths also avoid the vertices of
+  // the reported paths so that they explore other regions of the graph
+  const bool avoid_reported = maxSharedFraction < 1.0;
+  std::vector<bool> on_reported(mNumNodes, false);
+  numThreads = std::max(numThreads, size_t(1));
+  ThreadPool pool(numThreads);
+  size_t num_examined = 0;
+  while (results.size() < k && !candidates.empty() &&
+         num_examined < maxCandidates) {
+    const std::vector<size_t> path = candidates.begin()->second;
+    candidates.erase(candidates.begin());
+    ++num_examined;
+    // check the fraction of the vertices shared with the reported paths
+    std::vector<size_t> vertices(path);
+    std::sort(vertices.begin(), vertices.end());
+    bool distinct = true;
+    for (const auto &reported : reported_vertices) {
+      std::vector<size_t> shared;
+      std::set_intersection(vertices.begin(), vertices.end(),
+                            reported.begin(), reported.end(),
+                            std::back_inserter(shared));
+      if (shared.size() > maxSharedFraction * vertices.size()) {
+        distinct = false;
+        break;
+      }
+    }
+    // the paths similar to a reported one are dropped without generating
+    // their deviations, which would be similar as well
+    if (!distinct)
+      continue;
+    results.push_back(FindPathResult{0, {}, path, {}});
+    reported_vertices.push_back(vertices);
+    for (const auto &i : path) {
+      on_reported[i] = (i != end);
+    }
+    if (results.size() == k)
+      break;
+    expanded.push_back(path);
+    // the spur path from path[i] avoids the root path[0..i - 1], and
+    // leaves path[i] by an edge not taken by the expanded paths sharing
+    // the same root
+    std::vector<std::vector<size_t>> deviations(path.size() - 1);
+    pool.parallelFor(path.size() - 1, [&](size_t begin, size_t stop,
+                                          size_t) {
+      std::vector<bool> blocked(mNumNodes, false);
+      std::vector<bool> blocked_next(mNumNodes, false);
+      std::vector<bool> visited;
+      std::vector<size_t> previous;
+      std::vector<DistanceType> distances;
+      size_t reached_end = mNumNodes;
+      for (size_t i = begin; i < stop; ++i) {
+        const size_t spur = path[i];
+        for (size_t j = 0; j < i; ++j)
+          blocked[path[j]] = true;
+        auto is_blocked = [&](size_t to) {
+          return blocked[to] || (avoid_reported && on_reported[to]);
+        };
+        std::vector<size_t> blocked_list;
+        for (const auto &p : expanded) {
+          if (p.size() > i + 1 &&
+              std::equal(p.begin(), p.begin() + i + 1, path.begin())) {
+            blocked_next[p[i + 1]] = true;
+            blocked_list.push_back(p[i + 1]);
+          }
+        }
+        // the path in the shortest path tree is the best spur path if it
+        // is not blocked
+        std::vector<size_t> spur_path{spur};
+        bool tree_path_ok = tree_visited[spur] && spur != end &&
+                            !blocked_next[next[spur]];
+        while (tree_path_ok && spur_path.back() != end) {
+          spur_path.push_back(next[spur_path.back()]);
+          tree_path_ok = !is_blocked(spur_path.back());
+        }
+        if (!tree_path_ok) {
+          total_loops += DijkstraTree(
+              std::vector<size_t>{spur}, std::vector<size_t>{end}, true,
+              dist_start, dist_infinity, calc_new_dist, visited, previous,
+              distances, reached_end, [&](size_t from, size_t to) {
+                return is_blocked(to) || (from == spur && blocked_next[to]);
+              });
+          spur_path.clear();
+          if (reached_end == end)
+            spur_path = traceTree(previous, end);
+        }
+        if (!spur_path.empty()) {
+          deviations[i].assign(path.begin(), path.begin() + i);
+          deviations[i].insert(deviations[i].end(), spur_path.begin(),
+                               spur_path.end());
+        }
+        for (size_t j = 0; j < i; ++j)
+          blocked[path[j]] = false;
+        for (const auto &j : blocked_list)
+          blocked_next[j] = false;
+      }
+    });
+    for (auto &deviation : deviations) {
+      if (!deviation.empty() && generated.insert(deviation).second) {
+        candidates.insert(std::make_pair(pathCost(deviation), deviation));
+      }
+    }
+  }
+  for (auto &result : results) {
+    result.mNumLoops = total_loops;
+  }
+  qDebug() << "Yen's algorithm finds" << results.size() << "paths from"
+           << num_examined << "examined paths in" << timer.elapsed()
+           << "milliseconds with" << numThreads
+           << "threads; total number of loops:" << total_loops.load();
+  return results;
+}
+
+std::vector<Graph::FindPathResult>
+Graph::KShortestPaths(size_t start, size_t end, size_t k,
+                      Graph::FindPathMode mode, double maxSharedFraction,
+                      size_t maxCandidates, size_t numThreads) const {
+  switch (mode) {
+  case Graph::FindPathMode::SumOfEdges: {
+    const double dist_inf = std::numeric_limits<double>::max();
+    return KShortestPaths<double>(
+        start, end, k, 0, dist_inf,
+        [](const double &x, const double &y) { return x + y; },
+        maxSharedFraction, maxCandidates, numThreads);
+  }
+  case Graph::FindPathMode::MaximumEdges: {
+    const double dist_inf = std::numeric_limits<double>::max();
+    return KShortestPaths<double>(
+        start, end, k, std::numeric_limits<double>::lowest(), dist_inf,
+        [](const double &x, const double &y) { return std::max(x, y); },
+        maxSharedFraction, maxCandidates, numThreads);
+  }
+  case Graph::FindPathMode::MFEPMode: {
+    const MFEPDistance dist_start;
+    const MFEPDistance dist_inf({std::numeric_limits<double>::max()});
+    return KShortestPaths<MFEPDistance>(
+        start, end, k, dist_start, dist_inf,
+        [](const MFEPDistance &x, const double &weight) { return x + weight; },
+        maxSharedFraction, maxCandidates, numThreads);
+  }
+  default: {
+    return std::vector<FindPathResult>();
+  }
+  }
+}
+
 Graph::FindPathResult Graph::SPFA(size_t start, size_t end,
                                   Graph::FindPathMode mode) {
   switch (mode) {
@@ -146,7 +495,7 @@ Graph::FindPathResult Graph::SPFA(size_t start, size_t end,
   case Graph::FindPathMode::MaximumEdges: {
     const double dist_inf = std::numeric_limits<double>::max();
     return SPFA<double>(
-        start, end, findMaxSumWeight() + 1.0, dist_inf,
+        start, end, std::numeric_limits<double>::lowest(), dist_inf,
         [](const double &x, const double &y) { return std::max(x, y); });
     break;
   }
@@ -164,6 +513,263 @@ Graph::FindPathResult Graph::SPFA(size_t start, size_t end,
   }
 }
 
+Graph::FindPathResult Graph::AStar(size_t start, size_t end,
+                                   Graph::FindPathMode mode,
+                                   const std::vector<double> &heuristic) const {
+  switch (mode) {
+  case Graph::FindPathMode::SumOfEdges: {
+    const double dist_inf = std::numeric_limits<double>::max();
+    return AStar<double>(
+        start, end, 0, dist_inf,
+        [](const double &x, const double &y) { return x + y; },
+        [&heuristic](const double &x, size_t i) { return x + heuristic[i]; });
+    break;
+  }
+  case Graph::FindPathMode::MaximumEdges: {
+    const double dist_inf = std::numeric_limits<double>::max();
+    return AStar<double>(
+        start, end, std::numeric_limits<double>::lowest(), dist_inf,
+        [](const double &x, const double &y) { return std::max(x, y); },
+        [&heuristic](const double &x, size_t i) {
+          return std::max(x, heuristic[i]);
+        });
+    break;
+  }
+  case Graph::FindPathMode::MFEPMode: {
+    // there is no simple lower bound of the MFEP distance, so A* reduces to
+    // Dijkstra's algorithm
+    qDebug() << Q_FUNC_INFO << ": A* is not available in MFEP mode,"
+             << "use Dijkstra's algorithm instead.";
+    const MFEPDistance dist_start;
+    const MFEPDistance dist_inf({std::numeric_limits<double>::max()});
+    return Dijkstra<MFEPDistance>(
+        start, end, dist_start, dist_inf,
+        [](const MFEPDistance &x, const double &weight) { return x + weight; });
+  }
+  default: {
+    return FindPathResult();
+    break;
+  }
+  }
+}
+
+Graph::FindPathResult Graph::BidirectionalDijkstra(size_t start, size_t end,
+                                                   FindPathMode mode) const {
+  switch (mode) {
+  case Graph::FindPathMode::SumOfEdges: {
+    const double dist_inf = std::numeric_limits<double>::max();
+    return BidirectionalDijkstra<double>(
+        start, end, 0, dist_inf,
+        [](const double &x, const double &y) { return x + y; },
+        [](const double &x, const double &y) { return x + y; });
+    break;
+  }
+  case Graph::FindPathMode::MaximumEdges: {
+    const double dist_inf = std::numeric_limits<double>::max();
+    return BidirectionalDijkstra<double>(
+        start, end, std::numeric_limits<double>::lowest(), dist_inf,
+        [](const double &x, const double &y) { return std::max(x, y); },
+        [](const double &x, const double &y) { return std::max(x, y); });
+    break;
+  }
+  case Graph::FindPathMode::MFEPMode: {
+    // the MFEP distances from both sides cannot be joined
+    qDebug() << Q_FUNC_INFO
+             << ": bidirectional search is not available in MFEP mode,"
+             << "use Dijkstra's algorithm instead.";
+    const MFEPDistance dist_start;
+    const MFEPDistance dist_inf({std::numeric_limits<double>::max()});
+    return Dijkstra<MFEPDistance>(
+        start, end, dist_start, dist_inf,
+        [](const MFEPDistance &x, const double &weight) { return x + weight; });
+  }
+  default: {
+    return FindPathResult();
+    break;
+  }
+  }
+}
+
+Graph::FindPathResult Graph::DeltaStepping(size_t start, size_t end,
+                                           FindPathMode mode, double delta,
+                                           size_t numThreads) const {
+  if (!(delta > 0)) {
+    if (mode == Graph::FindPathMode::MaximumEdges) {
+      // the distances are bounded by the edge weights, and coarse buckets
+      // lead to lots of repeated relaxations
+      delta = (findMaxWeight() - findMinWeight()) / 1024.0;
+    } else {
+      delta = findMeanWeight();
+    }
+    if (!(delta > 0))
+      delta = 1.0;
+    qDebug() << Q_FUNC_INFO << ": use" << delta << "as the bucket width";
+  }
+  switch (mode) {
+  case Graph::FindPathMode::SumOfEdges: {
+    const double dist_inf = std::numeric_limits<double>::max();
+    return DeltaStepping(
+        start, end, 0, dist_inf,
+        [](const double &x, const double &y) { return x + y; }, delta,
+        numThreads);
+    break;
+  }
+  case Graph::FindPathMode::MaximumEdges: {
+    const double dist_inf = std::numeric_limits<double>::max();
+    return DeltaStepping(
+        start, end, std::numeric_limits<double>::lowest(), dist_inf,
+        [](const double &x, const double &y) { return std::max(x, y); },
+        delta, numThreads);
+    break;
+  }
+  case Graph::FindPathMode::MFEPMode: {
+    // MFEP distances cannot be put into buckets
+    qDebug() << Q_FUNC_INFO << ": delta-stepping is not available in MFEP"
+             << "mode, use Dijkstra's algorithm instead.";
+    const MFEPDistance dist_start;
+    const MFEPDistance dist_inf({std::numeric_limits<double>::max()});
+    return Dijkstra<MFEPDistance>(
+        start, end, dist_start, dist_inf,
+        [](const MFEPDistance &x, const double &weight) { return x + weight; });
+  }
+  default: {
+    return FindPathResult();
+    break;
+  }
+  }
+}
+
+Graph::FindPathResult
+Graph::DeltaStepping(size_t start, size_t end, double dist_start,
+                     double dist_infinity,
+                     std::function<double(double, double)> calc_new_dist,
+                     double delta, size_t numThreads) const {
+  qDebug() << "Calling" << Q_FUNC_INFO;
+  // calc_new_dist should never decrease the distance, so that a vertex in
+  // the current bucket can only update vertices in the same or later buckets
+  const double offset = std::min(0.0, findMinWeight());
+  auto bucketIndex = [offset, delta](double distance) {
+    if (distance <= offset)
+      return size_t(0);
+    return static_cast<size_t>((distance - offset) / delta);
+  };
+  struct Request {
+    size_t mDestination;
+    size_t mSource;
+    double mDistance;
+  };
+  ThreadPool pool(numThreads);
+  numThreads = pool.numThreads();
+  // requests[i][j] are generated by thread i for the vertices owned by thread
+  // j, so each vertex is only updated by one thread
+  std::vector<std::vector<std::vector<Request>>> requests(
+      numThreads, std::vector<std::vector<Request>>(numThreads));
+  std::vector<std::vector<size_t>> updated(numThreads);
+  std::vector<double> distances(mNumNodes, dist_infinity);
+  std::vector<size_t> previous(mNumNodes, mNumNodes);
+  // use char instead of bool to avoid data races on the packed bits
+  std::vector<char> isUpdated(mNumNodes, 0);
+  std::vector<char> isSettled(mNumNodes, 0);
+  std::vector<char> inFrontier(mNumNodes, 0);
+  std::map<size_t, std::vector<size_t>> buckets;
+  distances[start] = dist_start;
+  buckets[bucketIndex(dist_start)].push_back(start);
+  // generate the relaxation requests from the frontier, keeping only the ones
+  // that land in the current bucket (light) or in the later buckets (heavy)
+  auto relax = [&](const std::vector<size_t> &frontier, size_t currentBucket,
+                   bool light) {
+    pool.parallelFor(frontier.size(), [&](size_t begin, size_t stop,
+                                          size_t threadIndex) {
+      auto &localRequests = requests[threadIndex];
+      for (size_t k = begin; k < stop; ++k) {
+        const size_t to_visit = frontier[k];
+        auto neighbor_node = std::next(mHead[to_visit].cbegin(), 1);
+        while (neighbor_node != mHead[to_visit].cend()) {
+          const size_t neighbor_index = neighbor_node->mIndex;
+          const double new_distance =
+              calc_new_dist(distances[to_visit], neighbor_node->mWeight);
+          if ((bucketIndex(new_distance) == currentBucket) == light &&
+              new_distance < distances[neighbor_index]) {
+            localRequests[neighbor_index % numThreads].push_back(
+                Request{neighbor_index, to_visit, new_distance});
+          }
+          std::advance(neighbor_node, 1);
+        }
+      }
+    });
+    // apply the requests
+    pool.run([&](size_t threadIndex) {
+      for (size_t i = 0; i < numThreads; ++i) {
+        auto &ownedRequests = requests[i][threadIndex];
+        for (const auto &r : ownedRequests) {
+          if (r.mDistance < distances[r.mDestination]) {
+            distances[r.mDestination] = r.mDistance;
+            previous[r.mDestination] = r.mSource;
+            if (isUpdated[r.mDestination] == 0) {
+              isUpdated[r.mDestination] = 1;
+              updated[threadIndex].push_back(r.mDestination);
+            }
+          }
+        }
+        ownedRequests.clear();
+      }
+    });
+    for (size_t i = 0; i < numThreads; ++i) {
+      for (const size_t &v : updated[i]) {
+        isUpdated[v] = 0;
+        buckets[bucketIndex(distances[v])].push_back(v);
+      }
+      updated[i].clear();
+    }
+  };
+  size_t loop = 0;
+  QElapsedTimer timer;
+  timer.start();
+  std::vector<size_t> frontier;
+  std::vector<size_t> settled;
+  while (!buckets.empty()) {
+    const size_t currentBucket = buckets.begin()->first;
+    settled.clear();
+    // vertices may re-enter the current bucket via light edges
+    while (buckets.count(currentBucket) > 0) {
+      frontier.clear();
+      for (const size_t &v : buckets[currentBucket]) {
+        // skip the outdated entries
+        if (inFrontier[v] == 0 && bucketIndex(distances[v]) == currentBucket) {
+          inFrontier[v] = 1;
+          frontier.push_back(v);
+        }
+      }
+      buckets.erase(currentBucket);
+      for (const size_t &v : frontier) {
+        inFrontier[v] = 0;
+        if (isSettled[v] == 0) {
+          isSettled[v] = 1;
+          settled.push_back(v);
+        }
+      }
+      relax(frontier, currentBucket, true);
+      ++loop;
+    }
+    relax(settled, currentBucket, false);
+    // the distance of the end is final if its bucket has been processed
+    if (distances[end] < dist_infinity &&
+        bucketIndex(distances[end]) <= currentBucket) {
+      break;
+    }
+  }
+  qDebug() << "Delta-stepping takes" << timer.elapsed()
+           << "milliseconds with" << numThreads
+           << "thread(s); total number of phases:" << loop;
+  std::vector<bool> visited(mNumNodes, false);
+  for (size_t i = 0; i < mNumNodes; ++i) {
+    visited[i] = isSettled[i] != 0;
+  }
+  FindPathResult result{loop, visited, tracePath(previous, start, end),
+                        distances};
+  return result;
+}
+
 double Graph::findMaxSumWeight() const {
   double result = 0;
   for (size_t i = 0; i < mNumNodes; ++i) {
@@ -176,6 +782,45 @@ double Graph::findMaxSumWeight() const {
   return result;
 }
 
+double Graph::findMinWeight() const {
+  double result = std::numeric_limits<double>::max();
+  for (size_t i = 0; i < mNumNodes; ++i) {
+    auto this_node = std::next(mHead[i].cbegin(), 1);
+    while (this_node != mHead[i].cend()) {
+      result = std::min(result, this_node->mWeight);
+      std::advance(this_node, 1);
+    }
+  }
+  return result;
+}
+
+double Graph::findMaxWeight() const {
+  double result = std::numeric_limits<double>::lowest();
+  for (size_t i = 0; i < mNumNodes; ++i) {
+    auto this_node = std::next(mHead[i].cbegin(), 1);
+    while (this_node != mHead[i].cend()) {
+      result = std::max(result, this_node->mWeight);
+      std::advance(this_node, 1);
+    }
+  }
+  return result;
+}
+
+double Graph::findMeanWeight() const {
+  const size_t numEdges = totalEdges();
+  if (numEdges == 0)
+    return 1.0;
+  double result = 0;
+  for (size_t i = 0; i < mNumNodes; ++i) {
+    auto this_node = std::next(mHead[i].cbegin(), 1);
+    while (this_node != mHead[i].cend()) {
+      result += std::abs(this_node->mWeight);
+      std::advance(this_node, 1);
+    }
+  }
+  return result / numEdges;
+}
+
 bool Graph::setEdgeHelper(size_t source, size_t destination, double weight) {
   if (source >= mNumNodes || destination >= mNumNodes || source == destination)
     return false;
@@ -216,6 +861,35 @@ void Graph::DFSHelper(size_t i, std::vector<bool> &visited,
   }
 }
 
+std::vector<size_t> Graph::tracePath(const std::vector<size_t> &previous,
+                                     size_t start, size_t end) const {
+  std::vector<size_t> path;
+  if (start != end && previous[end] == mNumNodes) {
+    // the end is not reachable
+    return path;
+  }
+  size_t target = end;
+  while (target != start) {
+    path.push_back(target);
+    target = previous[target];
+  }
+  path.push_back(start);
+  std::reverse(path.begin(), path.end());
+  return path;
+}
+
+std::vector<size_t> Graph::traceTree(const std::vector<size_t> &previous,
+                                     size_t end) const {
+  std::vector<size_t> path;
+  size_t target = end;
+  while (target != mNumNodes) {
+    path.push_back(target);
+    target = previous[target];
+  }
+  std::reverse(path.begin(), path.end());
+  return path;
+}
+
 void Graph::sortByWeight() {
   for (size_t i = 0; i < mNumNodes; ++i) {
     auto &current_list = mHead[i];
@@ -443,3 +1117,40 @@ QDebug operator<<(QDebug dbg, const MFEPDistance &rhs) {
   dbg << debug_string;
   return dbg;
 }
+
+// defined after operator<=> of MFEPDistance, whose return type is deduced
+bool Graph::isPathBetter(const std::vector<size_t> &lhs,
+                         const std::vector<size_t> &rhs,
+                         FindPathMode mode) const {
+  auto pathCost = [this](const std::vector<size_t> &path, auto dist_start,
+                         auto calc_new_dist) {
+    auto distance = dist_start;
+    double weight = 0;
+    for (size_t i = 1; i < path.size(); ++i) {
+      getEdge(path[i - 1], path[i], weight);
+      distance = calc_new_dist(distance, weight);
+    }
+    return distance;
+  };
+  switch (mode) {
+  case Graph::FindPathMode::SumOfEdges: {
+    auto sum = [](const double &x, const double &y) { return x + y; };
+    return pathCost(lhs, 0.0, sum) < pathCost(rhs, 0.0, sum);
+  }
+  case Graph::FindPathMode::MaximumEdges: {
+    const double lowest = std::numeric_limits<double>::lowest();
+    auto max = [](const double &x, const double &y) { return std::max(x, y); };
+    return pathCost(lhs, lowest, max) < pathCost(rhs, lowest, max);
+  }
+  case Graph::FindPathMode::MFEPMode: {
+    auto add = [](const MFEPDistance &x, const double &weight) {
+      return x + weight;
+    };
+    return pathCost(lhs, MFEPDistance(), add) <
+           pathCost(rhs, MFEPDistance(), add);
+  }
+  default: {
+    return false;
+  }
+  }
+}
@@ -34,6 +34,7 @@
 #include <limits>
 #include <list>
 #include <queue>
+#include <utility>
 #include <vector>
 
 #if defined(USE_BOOST_FIBONACCI_HEAP)
@@ -75,6 +76,10 @@ public:
   enum class FindPathAlgorithm {
     Dijkstra,
     SPFA,
+    AStar,
+    BidirectionalDijkstra,
+    DeltaStepping,
+    LPAStar,
   };
   struct Node {
     size_t mIndex;
@@ -102,6 +107,11 @@ public:
   void summary() const;
   size_t totalEdges() const;
   void DFS(size_t start, std::function<void(const Node &)> func) const;
+  // the vertices reachable from start, which are found by an iterative
+  // depth-first search so that large graphs do not overflow the stack
+  std::vector<bool> reachableFrom(size_t start) const;
+  size_t numNodes() const;
+  void forEachNeighbor(size_t i, std::function<void(const Node &)> func) const;
   FindPathResult Dijkstra(size_t start, size_t end, FindPathMode mode);
   template <typename DistanceType>
   FindPathResult Dijkstra(
@@ -114,7 +124,74 @@ public:
   SPFA(size_t start, size_t end, const DistanceType &dist_start,
        const DistanceType &dist_infinity,
        std::function<DistanceType(DistanceType, double)> calc_new_dist) const;
+  // heuristic[i] is a lower bound of the distance from node i to the end,
+  // which is combined with the distance from the start by the sum (for
+  // SumOfEdges) or the maximum (for MaximumEdges)
+  FindPathResult AStar(size_t start, size_t end, FindPathMode mode,
+                       const std::vector<double> &heuristic) const;
+  template <typename DistanceType>
+  FindPathResult
+  AStar(size_t start, size_t end, const DistanceType &dist_start,
+        const DistanceType &dist_infinity,
+        std::function<DistanceType(DistanceType, double)> calc_new_dist,
+        std::function<DistanceType(DistanceType, size_t)> calc_priority) const;
+  FindPathResult BidirectionalDijkstra(size_t start, size_t end,
+                                       FindPathMode mode) const;
+  // join_dist combines a distance from the start and a distance to the end,
+  // and dist_start should be its identity element
+  template <typename DistanceType>
+  FindPathResult BidirectionalDijkstra(
+      size_t start, size_t end, const DistanceType &dist_start,
+      const DistanceType &dist_infinity,
+      std::function<DistanceType(DistanceType, double)> calc_new_dist,
+      std::function<DistanceType(DistanceType, DistanceType)> join_dist) const;
+  // a non-positive delta selects a bucket width from the edge weights
+  FindPathResult DeltaStepping(size_t start, size_t end, FindPathMode mode,
+                               double delta, size_t numThreads) const;
+  FindPathResult
+  DeltaStepping(size_t start, size_t end, double dist_start,
+                double dist_infinity,
+                std::function<double(double, double)> calc_new_dist,
+                double delta, size_t numThreads) const;
+  // search from all vertices in starts simultaneously, which is equivalent
+  // to adding a super-source connected to them by zero-weight edges, and
+  // stop at the first vertex in ends that is reached (or search the whole
+  // graph if ends is empty)
+  FindPathResult MultiSourceDijkstra(const std::vector<size_t> &starts,
+                                     const std::vector<size_t> &ends,
+                                     FindPathMode mode) const;
+  template <typename DistanceType>
+  FindPathResult MultiSourceDijkstra(
+      const std::vector<size_t> &starts, const std::vector<size_t> &ends,
+      const DistanceType &dist_start, const DistanceType &dist_infinity,
+      std::function<DistanceType(DistanceType, double)> calc_new_dist) const;
+  // solve the shortest paths of (start, end) pairs, where the pairs sharing
+  // the same start share one shortest path tree and the different starts
+  // are searched concurrently. Only the paths of the results are filled,
+  // and the visited vertices are left empty.
+  std::vector<FindPathResult>
+  BatchDijkstra(const std::vector<std::pair<size_t, size_t>> &queries,
+                FindPathMode mode, size_t numThreads) const;
+  // Yen's algorithm for the k best loopless paths from start to end in the
+  // order of their costs, where at most maxCandidates paths are examined.
+  // If maxSharedFraction is less than 1, a path is reported only if at most
+  // that fraction of its vertices are on the paths reported before, and the
+  // spur paths avoid the vertices of the reported paths except the end, so
+  // that the paths are diverse but no longer the exact k best ones. The
+  // spur searches of a path run concurrently, and a spur search is skipped
+  // if the path from the spur vertex in the shortest path tree towards the
+  // end is not blocked. Only the paths of the results are filled.
+  std::vector<FindPathResult>
+  KShortestPaths(size_t start, size_t end, size_t k, FindPathMode mode,
+                 double maxSharedFraction, size_t maxCandidates,
+                 size_t numThreads) const;
+  // compare the costs of two paths in the same way as the searches do
+  bool isPathBetter(const std::vector<size_t> &lhs,
+                    const std::vector<size_t> &rhs, FindPathMode mode) const;
   double findMaxSumWeight() const;
+  double findMinWeight() const;
+  double findMaxWeight() const;
+  double findMeanWeight() const;
 
 protected:
   size_t mNumNodes;
@@ -123,6 +200,37 @@ protected:
   bool setEdgeHelper(size_t source, size_t destination, double weight = 1.0);
   void DFSHelper(size_t i, std::vector<bool> &visited,
                  std::function<void(const Node &)> func) const;
+  std::vector<size_t> tracePath(const std::vector<size_t> &previous,
+                                size_t start, size_t end) const;
+  // trace back from the end until a vertex without a previous one
+  std::vector<size_t> traceTree(const std::vector<size_t> &previous,
+                                size_t end) const;
+  // Dijkstra's algorithm from multiple starts, which runs until the first
+  // (or the last if stop_at_first_end is false) vertex in ends is visited,
+  // or the whole graph is searched if ends is empty. The edges (i, j) with
+  // is_blocked(i, j) being true are skipped. Returns the number of loops.
+  template <typename DistanceType>
+  size_t DijkstraTree(
+      const std::vector<size_t> &starts, const std::vector<size_t> &ends,
+      bool stop_at_first_end, const DistanceType &dist_start,
+      const DistanceType &dist_infinity,
+      std::function<DistanceType(DistanceType, double)> calc_new_dist,
+      std::vector<bool> &visited, std::vector<size_t> &previous,
+      std::vector<DistanceType> &distances, size_t &reached_end,
+      std::function<bool(size_t, size_t)> is_blocked = nullptr) const;
+  template <typename DistanceType>
+  std::vector<FindPathResult> KShortestPaths(
+      size_t start, size_t end, size_t k, const DistanceType &dist_start,
+      const DistanceType &dist_infinity,
+      std::function<DistanceType(DistanceType, double)> calc_new_dist,
+      double maxSharedFraction, size_t maxCandidates,
+      size_t numThreads) const;
+  template <typename DistanceType>
+  std::vector<FindPathResult> BatchDijkstra(
+      const std::vector<std::pair<size_t, size_t>> &queries,
+      const DistanceType &dist_start, const DistanceType &dist_infinity,
+      std::function<DistanceType(DistanceType, double)> calc_new_dist,
+      size_t numThreads) const;
 };
 
 template <typename DistanceType>
@@ -201,15 +309,7 @@ Graph::FindPathResult Graph::Dijkstra(
   }
   qDebug() << "Dijkstra's algorithm takes" << timer.elapsed()
            << "milliseconds; total number of loops:" << loop;
-  std::vector<size_t> path;
-  size_t target = end;
-  while (previous[target] != mNumNodes) {
-    path.push_back(target);
-    target = previous[target];
-  }
-  if (path.back() != end)
-    path.push_back(start);
-  std::reverse(path.begin(), path.end());
+  const std::vector<size_t> path = tracePath(previous, start, end);
   std::vector<double> res_distance(distances.size());
   for (size_t i = 0; i < distances.size(); ++i) {
     res_distance[i] = static_cast<double>(distances[i]);
@@ -314,6 +414,275 @@ Graph::FindPathResult Graph::SPFA(
   return result;
 }
 
+template <typename DistanceType>
+Graph::FindPathResult Graph::AStar(
+    size_t start, size_t end, const DistanceType &dist_start,
+    const DistanceType &dist_infinity,
+    std::function<DistanceType(DistanceType, double)> calc_new_dist,
+    std::function<DistanceType(DistanceType, size_t)> calc_priority) const {
+  qDebug() << "Calling" << Q_FUNC_INFO;
+  using std::make_pair;
+  using std::priority_queue;
+  typedef std::pair<DistanceType, size_t> DistNodePair;
+  std::vector<bool> visited(mNumNodes, false);
+  std::vector<size_t> previous(mNumNodes, mNumNodes);
+  std::vector<DistanceType> distances(mNumNodes, dist_infinity);
+  // the queue is ordered by the estimated total distance instead of the
+  // distance from the start
+  priority_queue<DistNodePair, std::vector<DistNodePair>,
+                 std::greater<DistNodePair>>
+      pq;
+  distances[start] = dist_start;
+  pq.push(make_pair(calc_priority(dist_start, start), start));
+  size_t loop = 0;
+  QElapsedTimer timer;
+  timer.start();
+  while (!pq.empty()) {
+    const size_t to_visit = pq.top().second;
+    pq.pop();
+    // the same vertex may be pushed multiple times, skip the outdated ones
+    if (visited[to_visit] == true)
+      continue;
+    visited[to_visit] = true;
+    if (to_visit == end) {
+      break;
+    }
+    auto neighbor_node = std::next(mHead[to_visit].cbegin(), 1);
+    while (neighbor_node != mHead[to_visit].cend()) {
+      const size_t neighbor_index = neighbor_node->mIndex;
+      if (visited[neighbor_index] == false) {
+        const DistanceType new_distance =
+            calc_new_dist(distances[to_visit], neighbor_node->mWeight);
+        if (new_distance < distances[neighbor_index]) {
+          distances[neighbor_index] = new_distance;
+          previous[neighbor_index] = to_visit;
+          pq.push(make_pair(calc_priority(new_distance, neighbor_index),
+                            neighbor_index));
+        }
+      }
+      std::advance(neighbor_node, 1);
+    }
+    ++loop;
+  }
+  qDebug() << "A* search takes" << timer.elapsed()
+           << "milliseconds; total number of loops:" << loop;
+  std::vector<double> res_distance(distances.size());
+  for (size_t i = 0; i < distances.size(); ++i) {
+    res_distance[i] = static_cast<double>(distances[i]);
+  }
+  FindPathResult result{loop, visited, tracePath(previous, start, end),
+                        res_distance};
+  return result;
+}
+
+template <typename DistanceType>
+Graph::FindPathResult Graph::BidirectionalDijkstra(
+    size_t start, size_t end, const DistanceType &dist_start,
+    const DistanceType &dist_infinity,
+    std::function<DistanceType(DistanceType, double)> calc_new_dist,
+    std::function<DistanceType(DistanceType, DistanceType)> join_dist) const {
+  qDebug() << "Calling" << Q_FUNC_INFO;
+  using std::make_pair;
+  using std::priority_queue;
+  typedef std::pair<DistanceType, size_t> DistNodePair;
+  // the backward search walks along the incoming edges
+  std::vector<std::vector<Node>> incoming(mNumNodes);
+  for (size_t i = 0; i < mNumNodes; ++i) {
+    auto neighbor_node = std::next(mHead[i].cbegin(), 1);
+    while (neighbor_node != mHead[i].cend()) {
+      incoming[neighbor_node->mIndex].push_back(
+          Node{i, neighbor_node->mWeight});
+      std::advance(neighbor_node, 1);
+    }
+  }
+  // index 0 is the forward search from the start, and index 1 is the
+  // backward search from the end
+  std::vector<bool> visited[2] = {std::vector<bool>(mNumNodes, false),
+                                  std::vector<bool>(mNumNodes, false)};
+  std::vector<size_t> previous[2] = {std::vector<size_t>(mNumNodes, mNumNodes),
+                                     std::vector<size_t>(mNumNodes, mNumNodes)};
+  std::vector<DistanceType> distances[2] = {
+      std::vector<DistanceType>(mNumNodes, dist_infinity),
+      std::vector<DistanceType>(mNumNodes, dist_infinity)};
+  priority_queue<DistNodePair, std::vector<DistNodePair>,
+                 std::greater<DistNodePair>>
+      pq[2];
+  distances[0][start] = dist_start;
+  distances[1][end] = dist_start;
+  pq[0].push(make_pair(dist_start, start));
+  pq[1].push(make_pair(dist_start, end));
+  // the shortest path found so far goes through the edge from meet_from to
+  // meet_to
+  DistanceType best_distance = dist_infinity;
+  size_t meet_from = mNumNodes;
+  size_t meet_to = mNumNodes;
+  if (start == end) {
+    best_distance = dist_start;
+    meet_from = start;
+  }
+  size_t loop = 0;
+  QElapsedTimer timer;
+  timer.start();
+  while (true) {
+    for (int d = 0; d < 2; ++d) {
+      while (!pq[d].empty() && visited[d][pq[d].top().second] == true) {
+        pq[d].pop();
+      }
+    }
+    if (pq[0].empty() || pq[1].empty())
+      break;
+    // no path through the unvisited vertices can be shorter
+    if (!(join_dist(pq[0].top().first, pq[1].top().first) < best_distance))
+      break;
+    // expand the smaller frontier
+    const int d = (pq[0].size() <= pq[1].size()) ? 0 : 1;
+    const size_t to_visit = pq[d].top().second;
+    pq[d].pop();
+    visited[d][to_visit] = true;
+    auto relax = [&](const Node &neighbor_node) {
+      const size_t neighbor_index = neighbor_node.mIndex;
+      const DistanceType new_distance =
+          calc_new_dist(distances[d][to_visit], neighbor_node.mWeight);
+      if (visited[d][neighbor_index] == false &&
+          new_distance < distances[d][neighbor_index]) {
+        distances[d][neighbor_index] = new_distance;
+        previous[d][neighbor_index] = to_visit;
+        pq[d].push(make_pair(new_distance, neighbor_index));
+      }
+      // check if the two searches meet
+      if (distances[1 - d][neighbor_index] < dist_infinity) {
+        const DistanceType total_distance =
+            join_dist(new_distance, distances[1 - d][neighbor_index]);
+        if (total_distance < best_distance) {
+          best_distance = total_distance;
+          meet_from = (d == 0) ? to_visit : neighbor_index;
+          meet_to = (d == 0) ? neighbor_index : to_visit;
+        }
+      }
+    };
+    if (d == 0) {
+      std::for_each(std::next(mHead[to_visit].cbegin(), 1),
+                    mHead[to_visit].cend(), relax);
+    } else {
+      std::for_each(incoming[to_visit].cbegin(), incoming[to_visit].cend(),
+                    relax);
+    }
+    ++loop;
+  }
+  qDebug() << "Bidirectional Dijkstra's algorithm takes" << timer.elapsed()
+           << "milliseconds; total number of loops:" << loop;
+  std::vector<size_t> path;
+  if (meet_from != mNumNodes) {
+    path = tracePath(previous[0], start, meet_from);
+    // follow the backward search tree to the end
+    size_t target = meet_to;
+    while (target != mNumNodes) {
+      path.push_back(target);
+      target = previous[1][target];
+    }
+  }
+  std::vector<bool> res_visited(mNumNodes, false);
+  std::vector<double> res_distance(mNumNodes);
+  for (size_t i = 0; i < mNumNodes; ++i) {
+    res_visited[i] = visited[0][i] || visited[1][i];
+    res_distance[i] = static_cast<double>(distances[0][i]);
+  }
+  FindPathResult result{loop, res_visited, path, res_distance};
+  return result;
+}
+
+template <typename DistanceType>
+Graph::FindPathResult Graph::MultiSourceDijkstra(
+    const std::vector<size_t> &starts, const std::vector<size_t> &ends,
+    const DistanceType &dist_start, const DistanceType &dist_infinity,
+    std::function<DistanceType(DistanceType, double)> calc_new_dist) const {
+  qDebug() << "Calling" << Q_FUNC_INFO;
+  std::vector<bool> visited;
+  std::vector<size_t> previous;
+  std::vector<DistanceType> distances;
+  size_t reached_end = mNumNodes;
+  QElapsedTimer timer;
+  timer.start();
+  const size_t loop =
+      DijkstraTree(starts, ends, true, dist_start, dist_infinity,
+                   calc_new_dist, visited, previous, distances, reached_end);
+  qDebug() << "Multi-source Dijkstra's algorithm takes" << timer.elapsed()
+           << "milliseconds; total number of loops:" << loop;
+  std::vector<double> res_distance(distances.size());
+  for (size_t i = 0; i < distances.size(); ++i) {
+    res_distance[i] = static_cast<double>(distances[i]);
+  }
+  FindPathResult result{loop, visited, traceTree(previous, reached_end),
+                        res_distance};
+  return result;
+}
+
+template <typename DistanceType>
+size_t Graph::DijkstraTree(
+    const std::vector<size_t> &starts, const std::vector<size_t> &ends,
+    bool stop_at_first_end, const DistanceType &dist_start,
+    const DistanceType &dist_infinity,
+    std::function<DistanceType(DistanceType, double)> calc_new_dist,
+    std::vector<bool> &visited, std::vector<size_t> &previous,
+    std::vector<DistanceType> &distances, size_t &reached_end,
+    std::function<bool(size_t, size_t)> is_blocked) const {
+  using std::make_pair;
+  using std::priority_queue;
+  typedef std::pair<DistanceType, size_t> DistNodePair;
+  visited.assign(mNumNodes, false);
+  previous.assign(mNumNodes, mNumNodes);
+  distances.assign(mNumNodes, dist_infinity);
+  reached_end = mNumNodes;
+  std::vector<bool> is_end(mNumNodes, false);
+  size_t num_remaining_ends = 0;
+  for (const auto &i : ends) {
+    if (is_end[i] == false) {
+      is_end[i] = true;
+      ++num_remaining_ends;
+    }
+  }
+  priority_queue<DistNodePair, std::vector<DistNodePair>,
+                 std::greater<DistNodePair>>
+      pq;
+  // the edges from the super-source to the starts do not change the distance
+  for (const auto &i : starts) {
+    distances[i] = dist_start;
+    pq.push(make_pair(dist_start, i));
+  }
+  size_t loop = 0;
+  while (!pq.empty()) {
+    const size_t to_visit = pq.top().second;
+    pq.pop();
+    if (visited[to_visit] == true)
+      continue;
+    visited[to_visit] = true;
+    if (is_end[to_visit] == true) {
+      if (reached_end == mNumNodes)
+        reached_end = to_visit;
+      --num_remaining_ends;
+      if (stop_at_first_end || num_remaining_ends == 0)
+        break;
+    }
+    auto neighbor_node = std::next(mHead[to_visit].cbegin(), 1);
+    while (neighbor_node != mHead[to_visit].cend()) {
+      const size_t neighbor_index = neighbor_node->mIndex;
+      if (visited[neighbor_index] == false &&
+          !(is_blocked && is_blocked(to_visit, neighbor_index))) {
+        const DistanceType new_distance =
+            calc_new_dist(distances[to_visit], neighbor_node->mWeight);
+        if (new_distance < distances[neighbor_index]) {
+          distances[neighbor_index] = new_distance;
+          previous[neighbor_index] = to_visit;
+          pq.push(make_pair(new_distance, neighbor_index));
+        }
+      }
+      std::advance(neighbor_node, 1);
+    }
+    ++loop;
+  }
+  return loop;
+}
+
 class MFEPDistance {
 public:
   MFEPDistance();
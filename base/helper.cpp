@@ -33,6 +33,46 @@ QString boolToString(bool x) {
     return "False";
 }
 
+void splitFields(QStringView line, QList<QStringView> &fields) {
+  fields.clear();
+  const qsizetype size = line.size();
+  qsizetype begin = 0;
+  while (begin < size) {
+    // skip the separators
+    while (begin < size && (line[begin].isSpace() || line[begin] == u'(' ||
+                            line[begin] == u')' || line[begin] == u',')) {
+      ++begin;
+    }
+    qsizetype end = begin;
+    while (end < size && !(line[end].isSpace() || line[end] == u'(' ||
+                           line[end] == u')' || line[end] == u',')) {
+      ++end;
+    }
+    if (end > begin) fields.append(line.mid(begin, end - begin));
+    begin = end;
+  }
+}
+
+std::vector<qint64> splitLineRanges(const char *data, qint64 size,
+                                    size_t numRanges) {
+  std::vector<qint64> boundaries{0};
+  for (size_t i = 1; i < numRanges; ++i) {
+    const qint64 guess = size / qint64(numRanges) * qint64(i);
+    if (guess <= boundaries.back())
+      continue;
+    // move the boundary to the beginning of the next line
+    const char *newline = static_cast<const char *>(
+        std::memchr(data + guess - 1, '\n', size - guess + 1));
+    if (newline == nullptr)
+      break;
+    const qint64 boundary = newline - data + 1;
+    if (boundary > boundaries.back() && boundary < size)
+      boundaries.push_back(boundary);
+  }
+  boundaries.push_back(size);
+  return boundaries;
+}
+
 double kbT(const double temperature, const QString &unit) {
   qDebug() << "Calling" << Q_FUNC_INFO;
   double factor = 1.0;
@@ -25,6 +25,7 @@
 #include <QString>
 #include <QStringList>
 #include <cmath>
+#include <cstring>
 #include <deque>
 #include <iostream>
 #include <limits>
@@ -152,6 +153,31 @@ void print_vector(const std::vector<T> &v, const char *head_line) {
 
 QString boolToString(bool x);
 
+// split a line at whitespaces, commas and parentheses like
+// QRegularExpression("[(),\\s]+") with Qt::SkipEmptyParts, but much faster
+void splitFields(QStringView line, QList<QStringView> &fields);
+
+// split the bytes data[0, size) into at most numRanges ranges of whole lines,
+// where the i-th range is [boundaries[i], boundaries[i + 1])
+std::vector<qint64> splitLineRanges(const char *data, qint64 size,
+                                    size_t numRanges);
+
+// call func(line) with each line of data[begin, end) copied into the reused
+// line, until func returns false
+template <typename Func>
+void forEachLine(const char *data, qint64 begin, qint64 end, QString &line,
+                 Func &&func) {
+  while (begin < end) {
+    const char *lineEnd = static_cast<const char *>(
+        std::memchr(data + begin, '\n', end - begin));
+    const qint64 lineSize = lineEnd ? lineEnd - (data + begin) : end - begin;
+    line = QLatin1String(data + begin, lineSize);
+    begin += lineSize + 1;
+    if (!func(line))
+      break;
+  }
+}
+
 double kbT(const double temperature, const QString &unit);
 
 template <typename T, typename Alloc>
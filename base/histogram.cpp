@@ -18,11 +18,15 @@
 */
 
 #include "histogram.h"
+#include "stringmethod.h"
+#include "threadpool.h"
 
 #include <QElapsedTimer>
 #include <algorithm>
 #include <cmath>
 #include <iterator>
+#include <limits>
+#include <numeric>
 
 HistogramBase::HistogramBase()
     : mNdim(0), mHistogramSize(0), mAxes(0), mPointTable(0), mAccu(0) {}
@@ -509,6 +513,8 @@ double Axis::period() const {
   return mPeriodicUpperBound - mPeriodicLowerBound;
 }
 
+bool GridDataRegion::empty() const { return mBoxes.empty() && mPoints.empty(); }
+
 AxisView::AxisView()
     : mColumn(0), mAxis(), mInPMF(false), mReweightingTo(false) {}
 
@@ -675,10 +681,76 @@ void HistogramPMFHistory::splitToFile(const QString &prefix) const {
   }
 }
 
-PMFPathFinder::PMFPathFinder() { hasData = false; }
+namespace {
+// the bin indexes of an address, where the first axis changes fastest
+std::vector<size_t> indexOfAddress(const HistogramBase &histogram,
+                                   size_t address) {
+  std::vector<size_t> idx(histogram.dimension());
+  for (size_t i = 0; i < histogram.dimension(); ++i) {
+    const size_t bins = histogram.axes()[i].bin();
+    idx[i] = address % bins;
+    address /= bins;
+  }
+  return idx;
+}
+
+// halve the number of bins along each axis that has at least 4 bins (a
+// non-periodic axis with an odd number of bins is extended by one bin), and
+// keep the minimum of the merged bins so that the barriers are preserved
+HistogramScalar<double> minPoolHistogram(const HistogramScalar<double> &fine,
+                                         std::vector<size_t> &factors) {
+  const size_t dim = fine.dimension();
+  std::vector<Axis> axes = fine.axes();
+  factors.assign(dim, 1);
+  for (size_t k = 0; k < dim; ++k) {
+    const size_t bins = axes[k].bin();
+    const double width = axes[k].width();
+    if (bins < 4 || (bins % 2 != 0 && axes[k].periodic()))
+      continue;
+    if (bins % 2 != 0)
+      axes[k].setUpperBound(axes[k].upperBound() + width);
+    axes[k].setWidth(2.0 * width);
+    factors[k] = 2;
+  }
+  HistogramScalar<double> coarse(axes);
+  std::fill(coarse.data().begin(), coarse.data().end(),
+            std::numeric_limits<double>::max());
+  std::vector<size_t> idx(dim, 0);
+  std::vector<size_t> coarse_idx(dim, 0);
+  for (size_t i = 0; i < fine.histogramSize(); ++i) {
+    for (size_t k = 0; k < dim; ++k) {
+      coarse_idx[k] = idx[k] / factors[k];
+    }
+    const size_t addr = coarse.address(coarse_idx);
+    coarse[addr] = std::min(coarse[addr], fine[i]);
+    for (size_t k = 0; k < dim; ++k) {
+      if (++idx[k] < fine.axes()[k].bin())
+        break;
+      idx[k] = 0;
+    }
+  }
+  return coarse;
+}
+} // namespace
+
+PMFPathFinder::PMFPathFinder()
+    : mNumThreads(ThreadPool::defaultNumThreads()), mBucketWidth(0),
+      mNumLevels(0), mCorridorWidth(2), mCheckFullSearch(false),
+      mStringImages(0), mStringIterations(0), mStringStepSize(0),
+      mStringTolerance(1e-4), mNumAlternativePaths(0),
+      mMaxSharedFraction(1.0), mMaxCandidatePaths(0),
+      mEnergyCap(std::numeric_limits<double>::infinity()) {
+  hasData = false;
+}
 
 PMFPathFinder::PMFPathFinder(const HistogramScalar<double> &histogram,
-                             const std::vector<GridDataPatch> &patchList) {
+                             const std::vector<GridDataPatch> &patchList)
+    : mNumThreads(ThreadPool::defaultNumThreads()), mBucketWidth(0),
+      mNumLevels(0), mCorridorWidth(2), mCheckFullSearch(false),
+      mStringImages(0), mStringIterations(0), mStringStepSize(0),
+      mStringTolerance(1e-4), mNumAlternativePaths(0),
+      mMaxSharedFraction(1.0), mMaxCandidatePaths(0),
+      mEnergyCap(std::numeric_limits<double>::infinity()) {
   mHistogram = histogram;
   mPatchList = patchList;
   mHistogramBackup = histogram;
@@ -691,7 +763,13 @@ PMFPathFinder::PMFPathFinder(const HistogramScalar<double> &histogram,
                              const std::vector<double> &pos_start,
                              const std::vector<double> &pos_end,
                              Graph::FindPathMode mode,
-                             Graph::FindPathAlgorithm algorithm) {
+                             Graph::FindPathAlgorithm algorithm)
+    : mNumThreads(ThreadPool::defaultNumThreads()), mBucketWidth(0),
+      mNumLevels(0), mCorridorWidth(2), mCheckFullSearch(false),
+      mStringImages(0), mStringIterations(0), mStringStepSize(0),
+      mStringTolerance(1e-4), mNumAlternativePaths(0),
+      mMaxSharedFraction(1.0), mMaxCandidatePaths(0),
+      mEnergyCap(std::numeric_limits<double>::infinity()) {
   setup(histogram, patchList, pos_start, pos_end, mode, algorithm);
 }
 
@@ -708,6 +786,7 @@ void PMFPathFinder::setup(const HistogramScalar<double> &histogram,
   mHistogramBackup = histogram;
   mMode = mode;
   mAlgorithm = algorithm;
+  mDynamicPath = LifelongPlanningAStar();
   applyPatch();
   hasData = true;
 }
@@ -716,13 +795,74 @@ bool PMFPathFinder::initialized() const { return hasData; }
 
 void PMFPathFinder::findPath() {
   qDebug() << "Calling" << Q_FUNC_INFO;
+  // the multi-resolution search builds its own graphs of the corridors
+  if (mNumLevels > 0 && mBatchStarts.empty() && mStartRegion.empty() &&
+      mEndRegion.empty()) {
+    mDynamicPath = LifelongPlanningAStar();
+    findPathMultiResolution();
+    return;
+  }
   // setup the graph
   setupGraph();
+  mDynamicPath = LifelongPlanningAStar();
+  mAlternativeResults.clear();
+  if (!mBatchStarts.empty()) {
+    // the queries with invalid points get empty paths
+    std::vector<std::pair<size_t, size_t>> queries;
+    std::vector<size_t> valid_queries;
+    for (size_t i = 0; i < mBatchStarts.size(); ++i) {
+      bool startOk = false;
+      bool endOk = false;
+      const size_t start = mHistogram.address(mBatchStarts[i], &startOk);
+      const size_t end = mHistogram.address(mBatchEnds[i], &endOk);
+      if (startOk && endOk) {
+        queries.push_back(std::make_pair(start, end));
+        valid_queries.push_back(i);
+      } else {
+        qWarning() << "The start or end of query" << i
+                   << "is not in the grid.";
+      }
+    }
+    const auto results = mGraph.BatchDijkstra(queries, mMode, mNumThreads);
+    mBatchResults.assign(mBatchStarts.size(), Graph::FindPathResult());
+    for (size_t i = 0; i < valid_queries.size(); ++i) {
+      mBatchResults[valid_queries[i]] = results[i];
+    }
+    return;
+  }
+  if (!mStartRegion.empty() || !mEndRegion.empty()) {
+    const std::vector<size_t> starts =
+        regionAddresses(mStartRegion, mPosStart);
+    const std::vector<size_t> ends = regionAddresses(mEndRegion, mPosEnd);
+    qDebug() << "Number of bins in the start region:" << starts.size()
+             << "; number of bins in the end region:" << ends.size();
+    if (starts.empty() || ends.empty()) {
+      mResult = Graph::FindPathResult();
+      qWarning() << "The start or end region does not contain any bin.";
+    } else {
+      // the region search is only implemented by Dijkstra's algorithm
+      mResult = mGraph.MultiSourceDijkstra(starts, ends, mMode);
+    }
+    return;
+  }
   // find the starting address and ending address
   bool startOk = false;
   bool endOk = false;
   const size_t start = mHistogram.address(mPosStart, &startOk);
   const size_t end = mHistogram.address(mPosEnd, &endOk);
+  // fail fast if the start and end are separated by the bins above the
+  // energy cap, where the visited region is the part reachable from the
+  // start
+  if (startOk && endOk && std::isfinite(mEnergyCap)) {
+    const std::vector<bool> reachable = mGraph.reachableFrom(start);
+    if (reachable[end] == false) {
+      qWarning() << "The start and end are not connected below the energy "
+                    "cap"
+                 << mEnergyCap;
+      mResult = Graph::FindPathResult{0, reachable, {}, {}};
+      return;
+    }
+  }
   // check boundary
   if (startOk && endOk) {
     switch (mAlgorithm) {
@@ -734,21 +874,66 @@ void PMFPathFinder::findPath() {
       mResult = mGraph.SPFA(start, end, mMode);
       break;
     }
+    case Graph::FindPathAlgorithm::AStar: {
+      mResult = mGraph.AStar(start, end, mMode, heuristicToEnd(end));
+      break;
+    }
+    case Graph::FindPathAlgorithm::BidirectionalDijkstra: {
+      mResult = mGraph.BidirectionalDijkstra(start, end, mMode);
+      break;
+    }
+    case Graph::FindPathAlgorithm::DeltaStepping: {
+      mResult = mGraph.DeltaStepping(start, end, mMode, mBucketWidth,
+                                     mNumThreads);
+      break;
+    }
+    case Graph::FindPathAlgorithm::LPAStar: {
+      if (mMode == Graph::FindPathMode::MFEPMode) {
+        qDebug() << "LPA* does not support the MFEP mode, use Dijkstra's "
+                    "algorithm instead.";
+        mDynamicPath = LifelongPlanningAStar();
+        mResult = mGraph.Dijkstra(start, end, mMode);
+      } else {
+        mDynamicPath = LifelongPlanningAStar(mGraph, start, end, mMode);
+        mResult = mDynamicPath.computeShortestPath();
+      }
+      break;
+    }
     default: {
       mResult = Graph::FindPathResult();
       qDebug() << "Unimplemented algorithm!\n";
     }
     }
+    if (mNumAlternativePaths > 0) {
+      const size_t max_candidates = mMaxCandidatePaths > 0
+                                        ? mMaxCandidatePaths
+                                        : 100 * mNumAlternativePaths;
+      mAlternativeResults = mGraph.KShortestPaths(
+          start, end, mNumAlternativePaths, mMode, mMaxSharedFraction,
+          max_candidates, mNumThreads);
+    }
   }
 }
 
 void PMFPathFinder::writePath(const QString &filename) const {
   qDebug() << "Calling" << Q_FUNC_INFO;
+  writePathNodes(filename, mResult.mPathNodes);
+}
+
+void PMFPathFinder::writeBatchPaths(const QString &prefix) const {
+  qDebug() << "Calling" << Q_FUNC_INFO;
+  for (size_t i = 0; i < mBatchResults.size(); ++i) {
+    writePathNodes(prefix + "_" + QString::number(i) + ".path",
+                   mBatchResults[i].mPathNodes);
+  }
+}
+
+void PMFPathFinder::writePathNodes(const QString &filename,
+                                   const std::vector<size_t> &path) const {
   QFile ofs_file(filename);
   if (ofs_file.open(QFile::WriteOnly)) {
     QTextStream out_stream(&ofs_file);
     out_stream.setRealNumberNotation(QTextStream::ScientificNotation);
-    const auto &path = mResult.mPathNodes;
     for (size_t i = 0; i < path.size(); ++i) {
       const auto pos = mHistogram.reverseAddress(path[i]);
       for (size_t j = 0; j < mHistogram.dimension(); ++j) {
@@ -800,6 +985,109 @@ void PMFPathFinder::writePatchedPMF(const QString &filename) const {
   mHistogram.writeToFile(filename);
 }
 
+MergeTree PMFPathFinder::buildMergeTree() {
+  qDebug() << "Calling" << Q_FUNC_INFO;
+  setupGraph();
+  return MergeTree(mGraph, mHistogram.data());
+}
+
+void PMFPathFinder::writeMergeTree(const QString &filename,
+                                   const MergeTree &tree) const {
+  qDebug() << "Calling" << Q_FUNC_INFO;
+  QFile ofs_file(filename);
+  if (ofs_file.open(QFile::WriteOnly)) {
+    QTextStream out_stream(&ofs_file);
+    out_stream.setRealNumberNotation(QTextStream::ScientificNotation);
+    // each line is a local minimum or a saddle, with the index of its parent
+    // (-1 for a root), its position and its energy
+    out_stream << "# node parent position energy\n";
+    const auto &tree_nodes = tree.treeNodes();
+    for (size_t i = 0; i < tree_nodes.size(); ++i) {
+      const auto pos = mHistogram.reverseAddress(tree_nodes[i].mVertex);
+      out_stream << qSetFieldWidth(OUTPUT_WIDTH) << i << qSetFieldWidth(0)
+                 << ' ';
+      out_stream << qSetFieldWidth(OUTPUT_WIDTH);
+      if (tree_nodes[i].mParent == tree.numTreeNodes()) {
+        out_stream << -1;
+      } else {
+        out_stream << tree_nodes[i].mParent;
+      }
+      out_stream << qSetFieldWidth(0) << ' ';
+      for (size_t j = 0; j < mHistogram.dimension(); ++j) {
+        out_stream << qSetFieldWidth(OUTPUT_WIDTH);
+        out_stream.setRealNumberPrecision(OUTPUT_POSITION_PRECISION);
+        out_stream << pos[j];
+        out_stream << qSetFieldWidth(0) << ' ';
+      }
+      out_stream << qSetFieldWidth(OUTPUT_WIDTH);
+      out_stream.setRealNumberPrecision(OUTPUT_PRECISION);
+      out_stream << tree_nodes[i].mValue;
+      out_stream << qSetFieldWidth(0);
+      out_stream << '\n';
+    }
+    out_stream.flush();
+  } else {
+    qWarning() << "Failed to open file:" << filename;
+  }
+}
+
+void PMFPathFinder::writeBarrierMatrix(const QString &filename,
+                                       const MergeTree &tree) const {
+  qDebug() << "Calling" << Q_FUNC_INFO;
+  QFile ofs_file(filename);
+  if (ofs_file.open(QFile::WriteOnly)) {
+    QTextStream out_stream(&ofs_file);
+    out_stream.setRealNumberNotation(QTextStream::ScientificNotation);
+    // the rows and columns are the minima in the order of their tree nodes
+    const auto &minima = tree.minima();
+    out_stream << "# minima:";
+    for (const auto &i : minima) {
+      out_stream << ' ' << i;
+    }
+    out_stream << '\n';
+    const auto barriers = tree.minimaBarriers();
+    out_stream.setRealNumberPrecision(OUTPUT_PRECISION);
+    for (size_t i = 0; i < barriers.size(); ++i) {
+      for (size_t j = 0; j < barriers[i].size(); ++j) {
+        out_stream << qSetFieldWidth(OUTPUT_WIDTH) << barriers[i][j]
+                   << qSetFieldWidth(0) << ' ';
+      }
+      out_stream << '\n';
+    }
+    out_stream.flush();
+  } else {
+    qWarning() << "Failed to open file:" << filename;
+  }
+}
+
+void PMFPathFinder::setRegions(const GridDataRegion &startRegion,
+                               const GridDataRegion &endRegion) {
+  mStartRegion = startRegion;
+  mEndRegion = endRegion;
+}
+
+void PMFPathFinder::setBatchQueries(
+    const std::vector<std::vector<double>> &starts,
+    const std::vector<std::vector<double>> &ends) {
+  mBatchStarts = starts;
+  mBatchEnds = ends;
+  if (starts.size() != ends.size()) {
+    qWarning() << "The numbers of starts and ends of the queries mismatch.";
+    const size_t num_queries = std::min(starts.size(), ends.size());
+    mBatchStarts.resize(num_queries);
+    mBatchEnds.resize(num_queries);
+  }
+  mBatchResults.clear();
+}
+
+std::vector<Graph::FindPathResult> PMFPathFinder::batchResults() const {
+  return mBatchResults;
+}
+
+GridDataRegion PMFPathFinder::startRegion() const { return mStartRegion; }
+
+GridDataRegion PMFPathFinder::endRegion() const { return mEndRegion; }
+
 Graph::FindPathResult PMFPathFinder::result() const { return mResult; }
 
 HistogramScalar<double> PMFPathFinder::histogram() const { return mHistogram; }
@@ -813,10 +1101,17 @@ void PMFPathFinder::setupGraph() {
   QElapsedTimer timer;
   timer.start();
   mGraph = Graph(mHistogram.histogramSize(), true);
+  size_t num_capped = 0;
   for (size_t i = 0; i < mHistogram.histogramSize(); ++i) {
+    // the bins above the energy cap are isolated vertices
+    if (isAboveEnergyCap(mHistogram[i])) {
+      ++num_capped;
+      continue;
+    }
     const auto allNeighbors = mHistogram.allNeighborByAddress(i);
     for (size_t j = 0; j < allNeighbors.size(); ++j) {
-      if (allNeighbors[j].second == true) {
+      if (allNeighbors[j].second == true &&
+          !isAboveEnergyCap(mHistogram[allNeighbors[j].first])) {
         //        const double& pmf_i = mHistogram[i];
         const double &pmf_j = mHistogram[allNeighbors[j].first];
         //        const double grad_ij =  pmf_j - pmf_i;
@@ -828,36 +1123,132 @@ void PMFPathFinder::setupGraph() {
   }
   qDebug() << "Convert the PMF to a graph takes" << timer.elapsed()
            << "milliseconds.";
+  if (num_capped > 0) {
+    qDebug() << num_capped << "bins are above the energy cap" << mEnergyCap;
+  }
   mGraph.summary();
 }
 
-void PMFPathFinder::applyPatch() {
+bool PMFPathFinder::isAboveEnergyCap(double value) const {
+  return value > mEnergyCap;
+}
+
+std::vector<double> PMFPathFinder::heuristicToEnd(size_t end) const {
   qDebug() << "Calling" << Q_FUNC_INFO;
-  mHistogram = mHistogramBackup;
-  for (size_t i = 0; i < mHistogram.histogramSize(); ++i) {
-    const auto pos = mHistogram.reverseAddress(i);
-    for (size_t j = 0; j < mPatchList.size(); ++j) {
-      bool in_bound = true;
-      for (size_t k = 0; k < mHistogram.dimension(); ++k) {
-        const double width = mHistogram.axes()[k].width();
-        const size_t num_bins = std::floor(mPatchList[j].mLength[k] / width);
-        const double lower_bound =
-            mPatchList[j].mCenter[k] - 0.5 * mPatchList[j].mLength[k];
-        const double upper_bound =
-            mPatchList[j].mCenter[k] + 0.5 * mPatchList[j].mLength[k];
-        const Axis current_ax(lower_bound, upper_bound, num_bins, false);
-        //        qDebug() << "Construct an axis of" << current_ax;
-        if (!current_ax.inBoundary(pos[k])) {
-          in_bound = false;
-        } else {
-          //          qDebug() << pos << "is in the boundary of the patch.";
+  std::vector<double> heuristic(mHistogram.histogramSize(), 0.0);
+  switch (mMode) {
+  case Graph::FindPathMode::SumOfEdges: {
+    // each step costs at least the global minimum of the PMF, so the number
+    // of grid steps to the end times the minimum is admissible
+    const double min_weight = std::max(mHistogram.minimum(), 0.0);
+    const auto &axes = mHistogram.axes();
+    const std::vector<size_t> end_index = indexOfAddress(mHistogram, end);
+    for (size_t i = 0; i < mHistogram.histogramSize(); ++i) {
+      // the point table is not ordered by address, so compute the indexes
+      const std::vector<size_t> index = indexOfAddress(mHistogram, i);
+      size_t steps = 0;
+      for (size_t j = 0; j < mHistogram.dimension(); ++j) {
+        const size_t index_j = index[j];
+        size_t diff = index_j > end_index[j] ? index_j - end_index[j]
+                                             : end_index[j] - index_j;
+        if (axes[j].periodic()) {
+          diff = std::min(diff, axes[j].bin() - diff);
         }
+        steps += diff;
+      }
+      heuristic[i] = min_weight * steps;
+    }
+    break;
+  }
+  case Graph::FindPathMode::MaximumEdges: {
+    // any path has to enter the end, whose edge weight is the PMF there
+    std::fill(heuristic.begin(), heuristic.end(), mHistogram[end]);
+    break;
+  }
+  default: {
+    break;
+  }
+  }
+  return heuristic;
+}
+
+std::vector<size_t>
+PMFPathFinder::patchAddresses(const GridDataPatch &patch) const {
+  // find the range of bin indexes along each axis whose centers are in the
+  // box, and then enumerate the bins in the bounding box of the ranges
+  const size_t dim = mHistogram.dimension();
+  const auto &axes = mHistogram.axes();
+  std::vector<size_t> lower_index(dim);
+  std::vector<size_t> upper_index(dim);
+  for (size_t k = 0; k < dim; ++k) {
+    const double lower_bound = patch.mCenter[k] - 0.5 * patch.mLength[k];
+    const double upper_bound = patch.mCenter[k] + 0.5 * patch.mLength[k];
+    lower_index[k] = axes[k].bin();
+    upper_index[k] = 0;
+    for (size_t i = 0; i < axes[k].bin(); ++i) {
+      const double center = axes[k].lowerBound() + (0.5 + i) * axes[k].width();
+      if (center >= lower_bound && center <= upper_bound) {
+        lower_index[k] = std::min(lower_index[k], i);
+        upper_index[k] = std::max(upper_index[k], i);
       }
-      if (in_bound) {
-        //        qDebug() << "Previous value:" << mHistogram[i];
-        mHistogram[i] += mPatchList[j].mValue;
-        //        qDebug() << "Updated value:" << mHistogram[i];
+    }
+    if (lower_index[k] > upper_index[k])
+      return std::vector<size_t>();
+  }
+  std::vector<size_t> addresses;
+  std::vector<size_t> idx(lower_index);
+  while (true) {
+    addresses.push_back(mHistogram.address(idx));
+    // increase the index like an odometer
+    size_t k = 0;
+    for (; k < dim; ++k) {
+      if (idx[k] < upper_index[k]) {
+        ++idx[k];
+        break;
       }
+      idx[k] = lower_index[k];
+    }
+    if (k == dim)
+      break;
+  }
+  return addresses;
+}
+
+std::vector<size_t>
+PMFPathFinder::regionAddresses(const GridDataRegion &region,
+                               const std::vector<double> &point) const {
+  qDebug() << "Calling" << Q_FUNC_INFO;
+  std::vector<size_t> addresses;
+  std::vector<std::vector<double>> points = region.mPoints;
+  if (!point.empty()) {
+    points.push_back(point);
+  }
+  for (const auto &pos : points) {
+    bool inBoundary = false;
+    const size_t addr = mHistogram.address(pos, &inBoundary);
+    if (inBoundary) {
+      addresses.push_back(addr);
+    } else {
+      qWarning() << "Point" << pos << "is not in the grid.";
+    }
+  }
+  for (const auto &box : region.mBoxes) {
+    const auto box_addresses = patchAddresses(box);
+    addresses.insert(addresses.end(), box_addresses.begin(),
+                     box_addresses.end());
+  }
+  std::sort(addresses.begin(), addresses.end());
+  addresses.erase(std::unique(addresses.begin(), addresses.end()),
+                  addresses.end());
+  return addresses;
+}
+
+void PMFPathFinder::applyPatch() {
+  qDebug() << "Calling" << Q_FUNC_INFO;
+  mHistogram = mHistogramBackup;
+  for (size_t j = 0; j < mPatchList.size(); ++j) {
+    for (const auto &i : patchAddresses(mPatchList[j])) {
+      mHistogram[i] += mPatchList[j].mValue;
     }
   }
 }
@@ -890,6 +1281,299 @@ std::vector<double> PMFPathFinder::pathEnergy() const {
   return energy;
 }
 
+void PMFPathFinder::setMultiResolution(size_t numLevels, size_t corridorWidth,
+                                       bool checkFullSearch) {
+  mNumLevels = numLevels;
+  mCorridorWidth = corridorWidth;
+  mCheckFullSearch = checkFullSearch;
+}
+
+Graph PMFPathFinder::setupSubGraph(const HistogramScalar<double> &histogram,
+                                   const std::vector<size_t> &nodes,
+                                   std::vector<size_t> &localIndex) const {
+  qDebug() << "Calling" << Q_FUNC_INFO;
+  const size_t num_bins = histogram.histogramSize();
+  localIndex.assign(num_bins, num_bins);
+  for (size_t i = 0; i < nodes.size(); ++i) {
+    localIndex[nodes[i]] = i;
+  }
+  Graph graph(nodes.size(), true);
+  for (size_t i = 0; i < nodes.size(); ++i) {
+    if (isAboveEnergyCap(histogram[nodes[i]]))
+      continue;
+    const auto allNeighbors = histogram.allNeighborByAddress(nodes[i]);
+    for (size_t j = 0; j < allNeighbors.size(); ++j) {
+      if (allNeighbors[j].second == true &&
+          localIndex[allNeighbors[j].first] != num_bins &&
+          !isAboveEnergyCap(histogram[allNeighbors[j].first])) {
+        graph.setEdge(i, localIndex[allNeighbors[j].first],
+                      histogram[allNeighbors[j].first]);
+      }
+    }
+  }
+  return graph;
+}
+
+std::vector<size_t>
+PMFPathFinder::corridorNodes(const HistogramScalar<double> &histogram,
+                             const HistogramScalar<double> &coarseHistogram,
+                             const std::vector<size_t> &factors,
+                             const std::vector<size_t> &coarsePath) const {
+  qDebug() << "Calling" << Q_FUNC_INFO;
+  const size_t dim = histogram.dimension();
+  const auto &axes = histogram.axes();
+  const long width = static_cast<long>(mCorridorWidth);
+  std::vector<bool> in_corridor(histogram.histogramSize(), false);
+  std::vector<long> lower(dim);
+  std::vector<long> upper(dim);
+  std::vector<long> idx(dim);
+  std::vector<size_t> wrapped_idx(dim);
+  for (const auto &coarse_addr : coarsePath) {
+    // the bins merged into the coarse bin, extended by the corridor width
+    const auto coarse_idx = indexOfAddress(coarseHistogram, coarse_addr);
+    for (size_t k = 0; k < dim; ++k) {
+      const long factor = static_cast<long>(factors[k]);
+      lower[k] = static_cast<long>(coarse_idx[k]) * factor - width;
+      upper[k] = static_cast<long>(coarse_idx[k]) * factor + factor - 1 + width;
+    }
+    idx = lower;
+    while (true) {
+      bool in_grid = true;
+      for (size_t k = 0; k < dim; ++k) {
+        const long bins = static_cast<long>(axes[k].bin());
+        if (axes[k].periodic()) {
+          wrapped_idx[k] = ((idx[k] % bins) + bins) % bins;
+        } else if (idx[k] < 0 || idx[k] >= bins) {
+          in_grid = false;
+          break;
+        } else {
+          wrapped_idx[k] = idx[k];
+        }
+      }
+      if (in_grid)
+        in_corridor[histogram.address(wrapped_idx)] = true;
+      size_t k = 0;
+      for (; k < dim; ++k) {
+        if (idx[k] < upper[k]) {
+          ++idx[k];
+          break;
+        }
+        idx[k] = lower[k];
+      }
+      if (k == dim)
+        break;
+    }
+  }
+  std::vector<size_t> nodes;
+  for (size_t i = 0; i < in_corridor.size(); ++i) {
+    if (in_corridor[i])
+      nodes.push_back(i);
+  }
+  return nodes;
+}
+
+void PMFPathFinder::findPathMultiResolution() {
+  qDebug() << "Calling" << Q_FUNC_INFO;
+  QElapsedTimer timer;
+  timer.start();
+  // coarse[l - 1] is the grid of level l, and level 0 is the original grid
+  std::vector<HistogramScalar<double>> coarse;
+  std::vector<std::vector<size_t>> factors;
+  auto level = [&](size_t l) -> const HistogramScalar<double> & {
+    return l == 0 ? mHistogram : coarse[l - 1];
+  };
+  for (size_t l = 0; l < mNumLevels; ++l) {
+    std::vector<size_t> level_factors;
+    HistogramScalar<double> coarse_histogram =
+        minPoolHistogram(level(l), level_factors);
+    if (std::all_of(level_factors.begin(), level_factors.end(),
+                    [](size_t f) { return f == 1; }))
+      break;
+    factors.push_back(level_factors);
+    coarse.push_back(std::move(coarse_histogram));
+  }
+  qDebug() << "Number of coarse levels:" << coarse.size();
+  mResult = Graph::FindPathResult();
+  std::vector<size_t> path;
+  size_t total_loops = 0;
+  for (size_t l = coarse.size() + 1; l-- > 0;) {
+    const auto &histogram = level(l);
+    bool startOk = false;
+    bool endOk = false;
+    const size_t start = histogram.address(mPosStart, &startOk);
+    const size_t end = histogram.address(mPosEnd, &endOk);
+    if (!startOk || !endOk) {
+      qWarning() << "The start or end is not in the grid.";
+      return;
+    }
+    // search the whole coarsest grid, and only the corridors around the
+    // path of the previous level on the finer grids
+    std::vector<size_t> nodes;
+    if (l == coarse.size()) {
+      nodes.resize(histogram.histogramSize());
+      std::iota(nodes.begin(), nodes.end(), 0);
+    } else {
+      nodes = corridorNodes(histogram, level(l + 1), factors[l], path);
+    }
+    std::vector<size_t> local_index;
+    Graph graph = setupSubGraph(histogram, nodes, local_index);
+    const auto result =
+        graph.Dijkstra(local_index[start], local_index[end], mMode);
+    total_loops += result.mNumLoops;
+    qDebug() << "Level" << l << ": searching" << nodes.size() << "of"
+             << histogram.histogramSize() << "bins";
+    if (result.mPathNodes.empty()) {
+      qWarning() << "Failed to find the path at level" << l;
+      return;
+    }
+    path.resize(result.mPathNodes.size());
+    for (size_t i = 0; i < path.size(); ++i) {
+      path[i] = nodes[result.mPathNodes[i]];
+    }
+    if (l == 0) {
+      mResult.mVisitedNodes.assign(mHistogram.histogramSize(), false);
+      mResult.mDistances.assign(mHistogram.histogramSize(),
+                                std::numeric_limits<double>::max());
+      for (size_t i = 0; i < nodes.size(); ++i) {
+        mResult.mVisitedNodes[nodes[i]] = result.mVisitedNodes[i];
+        mResult.mDistances[nodes[i]] = result.mDistances[i];
+      }
+    }
+  }
+  mResult.mNumLoops = total_loops;
+  mResult.mPathNodes = path;
+  qDebug() << "Multi-resolution search takes" << timer.elapsed()
+           << "milliseconds; total number of loops:" << total_loops;
+  if (mCheckFullSearch) {
+    setupGraph();
+    const auto full_result = mGraph.Dijkstra(path.front(), path.back(), mMode);
+    const auto &full_path = full_result.mPathNodes;
+    qDebug() << "Full search: total number of loops:" << full_result.mNumLoops
+             << "; number of steps:" << full_path.size()
+             << "; multi-resolution search: number of steps:" << path.size();
+    if (full_path == path) {
+      qDebug() << "The multi-resolution path is identical to the full search.";
+    } else if (mGraph.isPathBetter(full_path, path, mMode)) {
+      qWarning() << "The multi-resolution path is worse than the full search. "
+                    "Consider increasing the corridor width.";
+    } else {
+      qDebug() << "The multi-resolution path differs from the full search "
+                  "but has the same cost.";
+    }
+  }
+}
+
+void PMFPathFinder::setStringMethod(size_t numImages, size_t maxIterations,
+                                    double stepSize, double tolerance) {
+  mStringImages = numImages;
+  mStringIterations = maxIterations;
+  mStringStepSize = stepSize;
+  mStringTolerance = tolerance;
+}
+
+void PMFPathFinder::refinePath() {
+  qDebug() << "Calling" << Q_FUNC_INFO;
+  mRefinedPath.clear();
+  mRefinedEnergy.clear();
+  if (mStringIterations == 0 || mResult.mPathNodes.size() < 2)
+    return;
+  const StringMethod string_method(mHistogram);
+  const auto result = string_method.optimize(
+      pathPosition(), mStringImages, mStringStepSize, mStringIterations,
+      mStringTolerance, mNumThreads);
+  if (!result.mConverged) {
+    qWarning() << "The string method does not converge in"
+               << result.mNumIterations << "iterations.";
+  }
+  mRefinedPath = result.mImages;
+  mRefinedEnergy = result.mEnergies;
+}
+
+std::vector<std::vector<double>> PMFPathFinder::refinedPathPosition() const {
+  return mRefinedPath;
+}
+
+std::vector<double> PMFPathFinder::refinedPathEnergy() const {
+  return mRefinedEnergy;
+}
+
+void PMFPathFinder::writeRefinedPath(const QString &filename) const {
+  qDebug() << "Calling" << Q_FUNC_INFO;
+  QFile ofs_file(filename);
+  if (ofs_file.open(QFile::WriteOnly)) {
+    QTextStream out_stream(&ofs_file);
+    out_stream.setRealNumberNotation(QTextStream::ScientificNotation);
+    for (size_t i = 0; i < mRefinedPath.size(); ++i) {
+      for (size_t j = 0; j < mRefinedPath[i].size(); ++j) {
+        out_stream << qSetFieldWidth(OUTPUT_WIDTH);
+        out_stream.setRealNumberPrecision(OUTPUT_POSITION_PRECISION);
+        out_stream << mRefinedPath[i][j];
+        out_stream << qSetFieldWidth(0) << ' ';
+      }
+      out_stream << qSetFieldWidth(OUTPUT_WIDTH);
+      out_stream.setRealNumberPrecision(OUTPUT_PRECISION);
+      out_stream << mRefinedEnergy[i];
+      out_stream << qSetFieldWidth(0);
+      out_stream << '\n';
+    }
+    out_stream.flush();
+  } else {
+    qWarning() << "Failed to open file:" << filename;
+  }
+}
+
+void PMFPathFinder::setAlternativePaths(size_t numPaths,
+                                        double maxSharedFraction,
+                                        size_t maxCandidates) {
+  mNumAlternativePaths = numPaths;
+  mMaxSharedFraction = maxSharedFraction;
+  mMaxCandidatePaths = maxCandidates;
+}
+
+std::vector<Graph::FindPathResult> PMFPathFinder::alternativeResults() const {
+  return mAlternativeResults;
+}
+
+void PMFPathFinder::writeAlternativePaths(const QString &prefix) const {
+  qDebug() << "Calling" << Q_FUNC_INFO;
+  // the summary of the paths: index, number of steps and the highest PMF
+  // value along the path
+  QFile ofs_file(prefix + ".alternatives");
+  if (ofs_file.open(QFile::WriteOnly)) {
+    QTextStream out_stream(&ofs_file);
+    out_stream.setRealNumberNotation(QTextStream::ScientificNotation);
+    for (size_t i = 0; i < mAlternativeResults.size(); ++i) {
+      const auto &path = mAlternativeResults[i].mPathNodes;
+      double barrier = std::numeric_limits<double>::lowest();
+      for (const auto &node : path) {
+        barrier = std::max(barrier, mHistogram[node]);
+      }
+      out_stream << qSetFieldWidth(OUTPUT_WIDTH) << i;
+      out_stream << qSetFieldWidth(0) << ' ';
+      out_stream << qSetFieldWidth(OUTPUT_WIDTH) << path.size();
+      out_stream << qSetFieldWidth(0) << ' ';
+      out_stream << qSetFieldWidth(OUTPUT_WIDTH);
+      out_stream.setRealNumberPrecision(OUTPUT_PRECISION);
+      out_stream << barrier;
+      out_stream << qSetFieldWidth(0);
+      out_stream << '\n';
+      writePathNodes(prefix + "_alt" + QString::number(i) + ".path", path);
+    }
+    out_stream.flush();
+  } else {
+    qWarning() << "Failed to open file:" << ofs_file.fileName();
+  }
+}
+
+void PMFPathFinder::setEnergyCap(double energyCap) {
+  mEnergyCap = energyCap;
+}
+
+void PMFPathFinder::setDeltaStepping(size_t numThreads, double bucketWidth) {
+  mNumThreads = numThreads > 0 ? numThreads : ThreadPool::defaultNumThreads();
+  mBucketWidth = bucketWidth;
+}
+
 std::vector<double> PMFPathFinder::posStart() const { return mPosStart; }
 
 void PMFPathFinder::setPosStart(const std::vector<double> &posStart) {
@@ -903,3 +1587,55 @@ std::vector<GridDataPatch> PMFPathFinder::patchList() const {
 void PMFPathFinder::setPatchList(const std::vector<GridDataPatch> &patchList) {
   mPatchList = patchList;
 }
+
+bool PMFPathFinder::updatePatchList(
+    const std::vector<GridDataPatch> &patchList) {
+  qDebug() << "Calling" << Q_FUNC_INFO;
+  // the patches may move bins across the energy cap, which changes the
+  // connectivity of the graph, so search again in that case
+  if (!mDynamicPath.initialized() || std::isfinite(mEnergyCap)) {
+    return false;
+  }
+  QElapsedTimer timer;
+  timer.start();
+  // only the bins covered by the old or new patches may change
+  std::vector<size_t> changed;
+  for (const auto &patch : mPatchList) {
+    const auto addresses = patchAddresses(patch);
+    changed.insert(changed.end(), addresses.begin(), addresses.end());
+  }
+  for (const auto &patch : patchList) {
+    const auto addresses = patchAddresses(patch);
+    changed.insert(changed.end(), addresses.begin(), addresses.end());
+  }
+  std::sort(changed.begin(), changed.end());
+  changed.erase(std::unique(changed.begin(), changed.end()), changed.end());
+  std::vector<double> new_values(changed.size());
+  for (size_t i = 0; i < changed.size(); ++i) {
+    new_values[i] = mHistogramBackup[changed[i]];
+  }
+  for (const auto &patch : patchList) {
+    for (const auto &addr : patchAddresses(patch)) {
+      const auto it = std::lower_bound(changed.begin(), changed.end(), addr);
+      new_values[std::distance(changed.begin(), it)] += patch.mValue;
+    }
+  }
+  // the weight of an edge is the value at its destination
+  size_t num_changed = 0;
+  for (size_t i = 0; i < changed.size(); ++i) {
+    const size_t addr = changed[i];
+    if (mHistogram[addr] == new_values[i])
+      continue;
+    mHistogram[addr] = new_values[i];
+    mGraph.forEachNeighbor(addr, [&](const Graph::Node &neighbor) {
+      mGraph.setEdge(neighbor.mIndex, addr, new_values[i]);
+    });
+    mDynamicPath.setIncomingWeight(addr, new_values[i]);
+    ++num_changed;
+  }
+  mPatchList = patchList;
+  mResult = mDynamicPath.computeShortestPath();
+  qDebug() << "Updating" << num_changed << "bins and repairing the path takes"
+           << timer.elapsed() << "milliseconds.";
+  return true;
+}
@@ -21,7 +21,9 @@
 #define HISTOGRAMBASE_H
 
 #include "base/graph.h"
+#include "base/dynamicpath.h"
 #include "base/helper.h"
+#include "base/mergetree.h"
 #include "base/common.h"
 
 #include <QDebug>
@@ -82,6 +84,14 @@ struct GridDataPatch {
   double mValue;
 };
 
+// a region of the grid consisting of boxes (the values of the patches are
+// ignored) and the bins containing a list of points
+struct GridDataRegion {
+  std::vector<GridDataPatch> mBoxes;
+  std::vector<std::vector<double>> mPoints;
+  bool empty() const;
+};
+
 struct AxisView {
   AxisView();
   int mColumn;
@@ -449,6 +459,8 @@ public:
   virtual void
   generate(std::function<std::vector<T>(const std::vector<double> &)> &func);
   size_t multiplicity() const;
+  const std::vector<T> &data() const;
+  std::vector<T> &data();
 
 protected:
   size_t mMultiplicity;
@@ -595,6 +607,15 @@ std::vector<T> HistogramVector<T>::operator()(const std::vector<T> &pos) const {
   }
 }
 
+template <typename T>
+const std::vector<T> &HistogramVector<T>::data() const {
+  return mData;
+}
+
+template <typename T> std::vector<T> &HistogramVector<T>::data() {
+  return mData;
+}
+
 template <typename T> T &HistogramVector<T>::operator[](int addr_mult) {
   return mData[addr_mult];
 }
@@ -688,26 +709,113 @@ public:
   HistogramScalar<double> histogramBackup() const;
   std::vector<GridDataPatch> patchList() const;
   void setPatchList(const std::vector<GridDataPatch> &patchList);
+  // change the patches and repair the path found by the LPA* algorithm
+  // incrementally; returns false if there is no such path to repair
+  bool updatePatchList(const std::vector<GridDataPatch> &patchList);
   std::vector<double> posStart() const;
   void setPosStart(const std::vector<double> &posStart);
   std::vector<double> posEnd() const;
   void setPosEnd(const std::vector<double> &posEnd);
   std::vector<std::vector<double>> pathPosition() const;
   std::vector<double> pathEnergy() const;
+  void setDeltaStepping(size_t numThreads, double bucketWidth);
+  // the bins whose values are higher than energyCap are not connected in the
+  // graph, and the start and end are checked to be connected before the
+  // search (infinity disables this)
+  void setEnergyCap(double energyCap);
+  // search on a grid coarsened numLevels times by min-pooling first, and then
+  // search only inside the corridor of corridorWidth bins around the path of
+  // the coarser level on each finer level (0 levels disable this)
+  void setMultiResolution(size_t numLevels, size_t corridorWidth,
+                          bool checkFullSearch);
+  // relax the path found on the grid by the string method on the
+  // interpolated PMF in refinePath() (0 iterations disable this)
+  void setStringMethod(size_t numImages, size_t maxIterations,
+                       double stepSize, double tolerance);
+  void refinePath();
+  std::vector<std::vector<double>> refinedPathPosition() const;
+  std::vector<double> refinedPathEnergy() const;
+  void writeRefinedPath(const QString &filename) const;
+  // find the numPaths best distinct paths by Yen's algorithm in findPath(),
+  // where a path is distinct if at most maxSharedFraction of its bins are on
+  // the previous paths, and at most maxCandidates paths are examined (0
+  // means 100 times numPaths)
+  void setAlternativePaths(size_t numPaths, double maxSharedFraction,
+                           size_t maxCandidates);
+  std::vector<Graph::FindPathResult> alternativeResults() const;
+  // write <prefix>_alt<i>.path for each path, and the number of steps and
+  // the highest PMF value of each path to <prefix>.alternatives
+  void writeAlternativePaths(const QString &prefix) const;
+  MergeTree buildMergeTree();
+  // search from any bin in the start region (and the start point) to any bin
+  // in the end region (and the end point) by a multi-source Dijkstra search
+  void setRegions(const GridDataRegion &startRegion,
+                  const GridDataRegion &endRegion);
+  GridDataRegion startRegion() const;
+  GridDataRegion endRegion() const;
+  // solve a batch of (start, end) queries in one findPath() call, where the
+  // queries sharing the same start share one search, and the different
+  // starts are searched concurrently by Dijkstra's algorithm
+  void setBatchQueries(const std::vector<std::vector<double>> &starts,
+                       const std::vector<std::vector<double>> &ends);
+  std::vector<Graph::FindPathResult> batchResults() const;
+  void writeBatchPaths(const QString &prefix) const;
+  void writeMergeTree(const QString &filename, const MergeTree &tree) const;
+  void writeBarrierMatrix(const QString &filename,
+                          const MergeTree &tree) const;
 
 private:
   void setupGraph();
+  bool isAboveEnergyCap(double value) const;
+  Graph setupSubGraph(const HistogramScalar<double> &histogram,
+                      const std::vector<size_t> &nodes,
+                      std::vector<size_t> &localIndex) const;
+  std::vector<size_t>
+  corridorNodes(const HistogramScalar<double> &histogram,
+                const HistogramScalar<double> &coarseHistogram,
+                const std::vector<size_t> &factors,
+                const std::vector<size_t> &coarsePath) const;
+  void findPathMultiResolution();
   void applyPatch();
+  std::vector<double> heuristicToEnd(size_t end) const;
+  void writePathNodes(const QString &filename,
+                      const std::vector<size_t> &path) const;
+  // the addresses of the bins whose centers are in the box of the patch
+  std::vector<size_t> patchAddresses(const GridDataPatch &patch) const;
+  std::vector<size_t> regionAddresses(const GridDataRegion &region,
+                                      const std::vector<double> &point) const;
   bool hasData;
   HistogramScalar<double> mHistogram;
   HistogramScalar<double> mHistogramBackup;
   std::vector<GridDataPatch> mPatchList;
   std::vector<double> mPosStart;
   std::vector<double> mPosEnd;
+  GridDataRegion mStartRegion;
+  GridDataRegion mEndRegion;
+  std::vector<std::vector<double>> mBatchStarts;
+  std::vector<std::vector<double>> mBatchEnds;
+  std::vector<Graph::FindPathResult> mBatchResults;
   Graph mGraph;
+  LifelongPlanningAStar mDynamicPath;
   Graph::FindPathAlgorithm mAlgorithm;
   Graph::FindPathMode mMode;
   Graph::FindPathResult mResult;
+  size_t mNumThreads;
+  double mBucketWidth;
+  size_t mNumLevels;
+  size_t mCorridorWidth;
+  bool mCheckFullSearch;
+  size_t mStringImages;
+  size_t mStringIterations;
+  double mStringStepSize;
+  double mStringTolerance;
+  std::vector<std::vector<double>> mRefinedPath;
+  std::vector<double> mRefinedEnergy;
+  size_t mNumAlternativePaths;
+  double mMaxSharedFraction;
+  size_t mMaxCandidatePaths;
+  std::vector<Graph::FindPathResult> mAlternativeResults;
+  double mEnergyCap;
 };
 
 Q_DECLARE_METATYPE(HistogramPMF);
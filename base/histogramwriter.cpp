@@ -0,0 +1,138 @@
+/*
+  PMFToolBox: A toolbox to analyze and post-process the output of
+  potential of mean force calculations.
+  Copyright (C) 2020  Haochuan Chen
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU Affero General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU Affero General Public License for more details.
+
+  You should have received a copy of the GNU Affero General Public License
+  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "histogramwriter.h"
+
+#include <QDebug>
+
+HistogramWriter::HistogramWriter() : mBusy(false), mShutdown(false) {
+  mThread = std::thread(&HistogramWriter::workerLoop, this);
+}
+
+HistogramWriter::~HistogramWriter() {
+  {
+    std::lock_guard<std::mutex> lk(mMutex);
+    mShutdown = true;
+  }
+  mQueueCondVar.notify_one();
+  if (mThread.joinable())
+    mThread.join();
+}
+
+std::vector<double> HistogramWriter::buffer() {
+  std::lock_guard<std::mutex> lk(mMutex);
+  if (mBuffers.empty())
+    return std::vector<double>();
+  std::vector<double> result = std::move(mBuffers.back());
+  mBuffers.pop_back();
+  return result;
+}
+
+void HistogramWriter::write(
+    std::shared_ptr<const HistogramScalar<double>> layout,
+    std::vector<double> &&data, const QString &filename, double factor) {
+  Job job;
+  job.mScalarLayout = std::move(layout);
+  job.mData = std::move(data);
+  job.mFilename = filename;
+  job.mFactor = factor;
+  enqueue(std::move(job));
+}
+
+void HistogramWriter::write(
+    std::shared_ptr<const HistogramVector<double>> layout,
+    std::vector<double> &&data, const QString &filename, double factor) {
+  Job job;
+  job.mVectorLayout = std::move(layout);
+  job.mData = std::move(data);
+  job.mFilename = filename;
+  job.mFactor = factor;
+  enqueue(std::move(job));
+}
+
+void HistogramWriter::flush() {
+  std::unique_lock<std::mutex> lk(mMutex);
+  mIdleCondVar.wait(lk, [this]() { return mJobs.empty() && !mBusy; });
+}
+
+void HistogramWriter::enqueue(Job &&job) {
+  {
+    std::lock_guard<std::mutex> lk(mMutex);
+    mJobs.push_back(std::move(job));
+  }
+  mQueueCondVar.notify_one();
+}
+
+void HistogramWriter::writeJob(Job &job) {
+  // swap the data in and out of the histogram of the layout, which leaves
+  // the histogram ready for the next job and the buffer for recycling
+  const auto scale = [&job](std::vector<double> &data) {
+    if (job.mFactor == 1.0)
+      return;
+    for (auto &x : data)
+      x *= job.mFactor;
+  };
+  bool write_ok = false;
+  if (job.mScalarLayout) {
+    if (job.mScalarLayout != mScalarLayout) {
+      mScalarLayout = job.mScalarLayout;
+      mScalar = *mScalarLayout;
+    }
+    mScalar.data().swap(job.mData);
+    scale(mScalar.data());
+    write_ok = mScalar.writeToFile(job.mFilename);
+    mScalar.data().swap(job.mData);
+  } else if (job.mVectorLayout) {
+    if (job.mVectorLayout != mVectorLayout) {
+      mVectorLayout = job.mVectorLayout;
+      mVector = *mVectorLayout;
+    }
+    mVector.data().swap(job.mData);
+    scale(mVector.data());
+    write_ok = mVector.writeToFile(job.mFilename);
+    mVector.data().swap(job.mData);
+  }
+  if (!write_ok) {
+    qWarning() << "Failed to write" << job.mFilename;
+  }
+}
+
+void HistogramWriter::workerLoop() {
+  while (true) {
+    Job job;
+    {
+      std::unique_lock<std::mutex> lk(mMutex);
+      mQueueCondVar.wait(lk, [this]() { return mShutdown || !mJobs.empty(); });
+      // finish the queued histograms before shutting down
+      if (mJobs.empty())
+        return;
+      job = std::move(mJobs.front());
+      mJobs.pop_front();
+      mBusy = true;
+    }
+    writeJob(job);
+    {
+      std::lock_guard<std::mutex> lk(mMutex);
+      mBuffers.push_back(std::move(job.mData));
+      mBusy = false;
+      if (mJobs.empty())
+        mIdleCondVar.notify_all();
+    }
+  }
+}
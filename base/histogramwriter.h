@@ -0,0 +1,84 @@
+/*
+  PMFToolBox: A toolbox to analyze and post-process the output of
+  potential of mean force calculations.
+  Copyright (C) 2020  Haochuan Chen
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU Affero General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU Affero General Public License for more details.
+
+  You should have received a copy of the GNU Affero General Public License
+  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef HISTOGRAMWRITER_H
+#define HISTOGRAMWRITER_H
+
+#include "base/histogram.h"
+
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <QString>
+
+// Writes histograms to files in a background thread. The caller copies the
+// data into a buffer recycled from the previous writes and hands it over
+// together with a histogram shared as the layout of the grid, so that it
+// neither copies the axes and the point table nor waits for formatting and
+// the disk. The histograms are written in the order of write().
+class HistogramWriter {
+public:
+  HistogramWriter();
+  // write all queued histograms before returning
+  ~HistogramWriter();
+  HistogramWriter(const HistogramWriter &) = delete;
+  HistogramWriter &operator=(const HistogramWriter &) = delete;
+  // a buffer of a finished write, or an empty vector if there is none
+  std::vector<double> buffer();
+  // queue writing the data on the grid of the layout multiplied by factor
+  void write(std::shared_ptr<const HistogramScalar<double>> layout,
+             std::vector<double> &&data, const QString &filename,
+             double factor = 1.0);
+  void write(std::shared_ptr<const HistogramVector<double>> layout,
+             std::vector<double> &&data, const QString &filename,
+             double factor = 1.0);
+  // wait until all queued histograms are written
+  void flush();
+
+private:
+  struct Job {
+    std::shared_ptr<const HistogramScalar<double>> mScalarLayout;
+    std::shared_ptr<const HistogramVector<double>> mVectorLayout;
+    std::vector<double> mData;
+    QString mFilename;
+    double mFactor;
+  };
+  void enqueue(Job &&job);
+  void writeJob(Job &job);
+  void workerLoop();
+  std::thread mThread;
+  std::mutex mMutex;
+  std::condition_variable mQueueCondVar;
+  std::condition_variable mIdleCondVar;
+  std::deque<Job> mJobs;
+  std::vector<std::vector<double>> mBuffers;
+  bool mBusy;
+  bool mShutdown;
+  // the histograms of the last layouts, which take the data of a job by
+  // swapping, and are only copied from a layout when it changes
+  std::shared_ptr<const HistogramScalar<double>> mScalarLayout;
+  std::shared_ptr<const HistogramVector<double>> mVectorLayout;
+  HistogramScalar<double> mScalar;
+  HistogramVector<double> mVector;
+};
+
+#endif // HISTOGRAMWRITER_H
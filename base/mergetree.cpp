@@ -0,0 +1,182 @@
+/*
+  PMFToolBox: A toolbox to analyze and post-process the output of
+  potential of mean force calculations.
+  Copyright (C) 2020  Haochuan Chen
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU Affero General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU Affero General Public License for more details.
+
+  You should have received a copy of the GNU Affero General Public License
+  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "mergetree.h"
+
+#include <QDebug>
+#include <QElapsedTimer>
+#include <algorithm>
+#include <limits>
+#include <numeric>
+
+namespace {
+size_t findRoot(std::vector<size_t> &component, size_t i) {
+  size_t root = i;
+  while (component[root] != root)
+    root = component[root];
+  // path compression
+  while (component[i] != root) {
+    const size_t next = component[i];
+    component[i] = root;
+    i = next;
+  }
+  return root;
+}
+} // namespace
+
+MergeTree::MergeTree() {}
+
+MergeTree::MergeTree(const Graph &graph, const std::vector<double> &values) {
+  build(graph, values);
+}
+
+void MergeTree::build(const Graph &graph, const std::vector<double> &values) {
+  qDebug() << "Calling" << Q_FUNC_INFO;
+  QElapsedTimer timer;
+  timer.start();
+  const size_t num_vertices = graph.numNodes();
+  mValues = values;
+  mTreeNodes.clear();
+  mMinima.clear();
+  mArc.assign(num_vertices, 0);
+  std::vector<size_t> order(num_vertices);
+  std::iota(order.begin(), order.end(), 0);
+  std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+    return mValues[a] < mValues[b];
+  });
+  // the union-find structure of the added vertices, and the highest tree
+  // node of each component (indexed by the root of the component)
+  std::vector<size_t> component(num_vertices);
+  std::iota(component.begin(), component.end(), 0);
+  std::vector<size_t> top(num_vertices, 0);
+  std::vector<bool> added(num_vertices, false);
+  std::vector<size_t> joined;
+  for (const size_t vertex : order) {
+    joined.clear();
+    graph.forEachNeighbor(vertex, [&](const Graph::Node &neighbor) {
+      if (added[neighbor.mIndex]) {
+        const size_t root = findRoot(component, neighbor.mIndex);
+        if (std::find(joined.begin(), joined.end(), root) == joined.end())
+          joined.push_back(root);
+      }
+    });
+    if (joined.size() == 1) {
+      // a regular vertex extends the arc of the only component
+      mArc[vertex] = top[joined[0]];
+      component[vertex] = joined[0];
+    } else {
+      const size_t tree_node = mTreeNodes.size();
+      mTreeNodes.push_back(TreeNode{vertex, tree_node, mValues[vertex]});
+      if (joined.empty())
+        mMinima.push_back(tree_node);
+      for (const size_t root : joined) {
+        mTreeNodes[top[root]].mParent = tree_node;
+        component[root] = vertex;
+      }
+      top[vertex] = tree_node;
+      mArc[vertex] = tree_node;
+    }
+    added[vertex] = true;
+  }
+  // mark the roots, and compute the depths from the roots since a parent is
+  // always created after its children
+  const size_t num_tree_nodes = mTreeNodes.size();
+  mDepth.assign(num_tree_nodes, 0);
+  for (size_t i = num_tree_nodes; i-- > 0;) {
+    if (mTreeNodes[i].mParent == i) {
+      mTreeNodes[i].mParent = num_tree_nodes;
+    } else {
+      mDepth[i] = mDepth[mTreeNodes[i].mParent] + 1;
+    }
+  }
+  mAncestors.clear();
+  mAncestors.push_back(std::vector<size_t>(num_tree_nodes));
+  for (size_t i = 0; i < num_tree_nodes; ++i) {
+    mAncestors[0][i] = mTreeNodes[i].mParent;
+  }
+  const size_t max_depth =
+      num_tree_nodes > 0 ? *std::max_element(mDepth.begin(), mDepth.end()) : 0;
+  for (size_t k = 1; (size_t(1) << k) <= max_depth; ++k) {
+    std::vector<size_t> ancestors(num_tree_nodes);
+    for (size_t i = 0; i < num_tree_nodes; ++i) {
+      const size_t half = mAncestors[k - 1][i];
+      ancestors[i] =
+          (half == num_tree_nodes) ? num_tree_nodes : mAncestors[k - 1][half];
+    }
+    mAncestors.push_back(std::move(ancestors));
+  }
+  qDebug() << "Building the merge tree takes" << timer.elapsed()
+           << "milliseconds; number of minima:" << mMinima.size()
+           << "; number of tree nodes:" << num_tree_nodes;
+}
+
+size_t MergeTree::numTreeNodes() const { return mTreeNodes.size(); }
+
+const std::vector<MergeTree::TreeNode> &MergeTree::treeNodes() const {
+  return mTreeNodes;
+}
+
+const std::vector<size_t> &MergeTree::minima() const { return mMinima; }
+
+size_t MergeTree::treeNodeOf(size_t vertex) const { return mArc[vertex]; }
+
+size_t MergeTree::lowestCommonAncestor(size_t treeNodeA,
+                                       size_t treeNodeB) const {
+  if (mDepth[treeNodeA] < mDepth[treeNodeB])
+    std::swap(treeNodeA, treeNodeB);
+  // lift the deeper one to the same depth
+  size_t diff = mDepth[treeNodeA] - mDepth[treeNodeB];
+  for (size_t k = 0; diff > 0; ++k, diff >>= 1) {
+    if (diff & 1)
+      treeNodeA = mAncestors[k][treeNodeA];
+  }
+  if (treeNodeA == treeNodeB)
+    return treeNodeA;
+  for (size_t k = mAncestors.size(); k-- > 0;) {
+    if (mAncestors[k][treeNodeA] != mAncestors[k][treeNodeB]) {
+      treeNodeA = mAncestors[k][treeNodeA];
+      treeNodeB = mAncestors[k][treeNodeB];
+    }
+  }
+  // the parents are different if the two nodes are in different trees
+  return mTreeNodes[treeNodeA].mParent;
+}
+
+double MergeTree::barrier(size_t source, size_t destination) const {
+  const size_t lca =
+      lowestCommonAncestor(treeNodeOf(source), treeNodeOf(destination));
+  if (lca == numTreeNodes())
+    return std::numeric_limits<double>::infinity();
+  // a vertex on the arc above the common ancestor is higher than it
+  return std::max({mValues[source], mValues[destination],
+                   mTreeNodes[lca].mValue});
+}
+
+std::vector<std::vector<double>> MergeTree::minimaBarriers() const {
+  std::vector<std::vector<double>> barriers(
+      mMinima.size(), std::vector<double>(mMinima.size()));
+  for (size_t i = 0; i < mMinima.size(); ++i) {
+    for (size_t j = i; j < mMinima.size(); ++j) {
+      barriers[i][j] = barrier(mTreeNodes[mMinima[i]].mVertex,
+                               mTreeNodes[mMinima[j]].mVertex);
+      barriers[j][i] = barriers[i][j];
+    }
+  }
+  return barriers;
+}
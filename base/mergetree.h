@@ -0,0 +1,70 @@
+/*
+  PMFToolBox: A toolbox to analyze and post-process the output of
+  potential of mean force calculations.
+  Copyright (C) 2020  Haochuan Chen
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU Affero General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU Affero General Public License for more details.
+
+  You should have received a copy of the GNU Affero General Public License
+  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef MERGETREE_H
+#define MERGETREE_H
+
+#include "base/graph.h"
+
+#include <cstddef>
+#include <vector>
+
+// The merge tree (disconnectivity graph) of a vertex-weighted graph. The
+// vertices are added in ascending order of their values, and the connected
+// components of the added vertices are tracked by a union-find structure.
+// A vertex joining no component is a local minimum (leaf), and a vertex
+// joining two or more components is a saddle (internal node). The minimax
+// barrier between two vertices is then the value at the lowest common
+// ancestor of their tree nodes, which is found in O(log N) by binary
+// lifting. The graph is treated as undirected.
+class MergeTree {
+public:
+  struct TreeNode {
+    size_t mVertex;
+    size_t mParent;
+    double mValue;
+  };
+  MergeTree();
+  MergeTree(const Graph &graph, const std::vector<double> &values);
+  void build(const Graph &graph, const std::vector<double> &values);
+  size_t numTreeNodes() const;
+  const std::vector<TreeNode> &treeNodes() const;
+  // indexes of the tree nodes of the local minima
+  const std::vector<size_t> &minima() const;
+  // the tree node whose arc contains the vertex
+  size_t treeNodeOf(size_t vertex) const;
+  // returns numTreeNodes() if the tree nodes are not connected
+  size_t lowestCommonAncestor(size_t treeNodeA, size_t treeNodeB) const;
+  // the lowest possible maximum value along all paths between two vertices,
+  // including the values at the two vertices themselves
+  double barrier(size_t source, size_t destination) const;
+  // the barrier matrix between all pairs of the local minima
+  std::vector<std::vector<double>> minimaBarriers() const;
+
+private:
+  std::vector<double> mValues;
+  std::vector<TreeNode> mTreeNodes;
+  std::vector<size_t> mMinima;
+  std::vector<size_t> mArc;
+  std::vector<size_t> mDepth;
+  // mAncestors[k][i] is the 2^k-th ancestor of tree node i
+  std::vector<std::vector<size_t>> mAncestors;
+};
+
+#endif // MERGETREE_H
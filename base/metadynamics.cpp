@@ -1,111 +1,119 @@
 #include "metadynamics.h"
 
 #include <QElapsedTimer>
+#include <QFileInfo>
 #include <QDebug>
+#include <QDataStream>
+#include <QSaveFile>
+#include <armadillo>
+#include <algorithm>
+#include <cmath>
+#include <future>
+#include <limits>
 #include <numeric>
 
-Metadynamics::Metadynamics(size_t numThreads):
-#ifdef SUM_HILLS_USE_STD_THREAD
-  mThreads(numThreads), mCondVars(numThreads), mMutexes(numThreads),
-  mTaskStates(numThreads, 0), mFirstTime(true), mShutdown(false)
-#endif
-#ifdef SUM_HILLS_USE_QT_CONCURRENT
-  mThreads(numThreads)
-#endif
+Metadynamics::Metadynamics(size_t numThreads, bool computeGradients):
+  mPool(numThreads > 0 ? numThreads : ThreadPool::defaultNumThreads()),
+  mComputeGradients(computeGradients), mNextTile(0), mFFT(false),
+  mSubgridSpreading(true)
 {
-//  mThreads.resize(numThreads);
-  mNumBlocks = 0;
-#ifdef SUM_HILLS_USE_STD_THREAD
-  std::cout << "Will use " << numThreads << " thread(s) to sum hills.\n";
-#endif
-#ifdef SUM_HILLS_USE_QT_CONCURRENT
-  qDebug() << "Will use" << numThreads << "thread(s) to sum hills.";
-#endif
-}
-
-Metadynamics::Metadynamics(const std::vector<Axis> &ax, size_t numThreads):
-#ifdef SUM_HILLS_USE_STD_THREAD
-  mThreads(numThreads), mCondVars(numThreads), mMutexes(numThreads),
-  mTaskStates(numThreads, 0), mFirstTime(true), mShutdown(false)
-#endif
-#ifdef SUM_HILLS_USE_QT_CONCURRENT
-  mThreads(numThreads)
-#endif
+  // the exponent at the cutoff is 100, beyond which the hills were already
+  // neglected
+  mHillCutoff = std::sqrt(200.0);
+  std::cout << "Will use " << mPool.numThreads() << " thread(s) to sum hills.\n";
+}
+
+Metadynamics::Metadynamics(const std::vector<Axis> &ax, size_t numThreads,
+                           bool computeGradients):
+  mPool(numThreads > 0 ? numThreads : ThreadPool::defaultNumThreads()),
+  mComputeGradients(computeGradients), mNextTile(0), mFFT(false),
+  mSubgridSpreading(true)
 {
-//  mThreads.resize(numThreads);
+  mHillCutoff = std::sqrt(200.0);
   setupHistogram(ax);
-#ifdef SUM_HILLS_USE_STD_THREAD
-  std::cout << "Will use " << numThreads << " thread(s) to sum hills.\n";
-#endif
-#ifdef SUM_HILLS_USE_QT_CONCURRENT
-  qDebug() << "Will use" << numThreads << "thread(s) to sum hills.";
-#endif
+  std::cout << "Will use " << mPool.numThreads() << " thread(s) to sum hills.\n";
 }
 
 Metadynamics::~Metadynamics()
 {
   std::cout << "Calling Metadynamics::~Metadynamics()\n";
-#ifdef SUM_HILLS_USE_STD_THREAD
-  mShutdown = true;
-  for (size_t i = 0; i < mCondVars.size(); ++i) {
-    std::unique_lock<std::mutex> lk(mMutexes[i]);
-    mTaskStates[i] = 0;
-    lk.unlock();
-    mCondVars[i].notify_one();
-  }
-  for (size_t i = 0; i < mThreads.size(); ++i) {
-    if (mThreads[i].joinable()) mThreads[i].join();
-  }
-#endif
 }
 
 void Metadynamics::setupHistogram(const std::vector<Axis> &ax) {
   mPMF = HistogramScalar<double>(ax);
-  mGradients = HistogramVector<double>(ax, ax.size());
-  mNumBlocks = mPMF.histogramSize() / mThreads.size() + 1;
-  mPointMap.assign(mPMF.histogramSize(), std::vector<double>(mPMF.dimension(), 0));
-  mAddressMap.assign(mPMF.histogramSize(), 0);
-  const std::vector<std::vector<double>>& tmpPointTable = mPMF.pointTable();
-  for (size_t i = 0; i < mPMF.histogramSize(); ++i) {
-    for (size_t j = 0; j < mPMF.dimension(); ++j) {
-      mPointMap[i][j] = tmpPointTable[j][i];
-    }
-    mAddressMap[i] = mPMF.address(mPointMap[i]);
+  mGradients = mComputeGradients ? HistogramVector<double>(ax, ax.size())
+                                 : HistogramVector<double>();
+  mMiddlePoints.resize(mPMF.dimension());
+  mAccu.assign(mPMF.dimension(), 1);
+  for (size_t j = 0; j < mPMF.dimension(); ++j) {
+    mMiddlePoints[j] = ax[j].getMiddlePoints();
+    if (j > 0) mAccu[j] = mAccu[j - 1] * ax[j - 1].bin();
   }
+  setupTiles();
+  resetDeposits();
 }
 
-void Metadynamics::launchThreads(const Metadynamics::HillRef &h) {
-#ifdef SUM_HILLS_USE_STD_THREAD
-  for (size_t i = 0; i < mThreads.size(); ++i) {
-    std::unique_lock<std::mutex> lk(mMutexes[i]);
-    mTaskStates[i] = 0;
-    lk.unlock();
-    if (mFirstTime) mThreads[i] = std::thread(&Metadynamics::projectHillParallelWorker, this, i, std::cref(h));
-    if (!mFirstTime) mCondVars[i].notify_one();
-  }
-  if (mFirstTime) mFirstTime = false;
-#endif
-#ifdef SUM_HILLS_USE_QT_CONCURRENT
-  for (int i = 0; i < mThreads.size(); ++i) {
-    mThreads[i] = QtConcurrent::run(this, &Metadynamics::projectHillParallelWorker, i, std::cref(h));
+void Metadynamics::setupTiles() {
+  // a few tiles per thread balance the load when the hills gather in a
+  // small region
+  const size_t tilesPerThread = 4;
+  // the tiles are a multiple of a cache line long in the PMF, and hence in
+  // the gradients, so that two threads share at most the cache line at the
+  // border of their tiles, since the grids are not aligned to a cache line
+  const size_t binsPerCacheLine = 64 / sizeof(double);
+  const size_t numBins = mPMF.data().size();
+  const size_t numTiles = mPool.numThreads() * tilesPerThread;
+  size_t tileSize = (numBins + numTiles - 1) / numTiles;
+  tileSize = std::max(binsPerCacheLine,
+                      (tileSize + binsPerCacheLine - 1) / binsPerCacheLine *
+                          binsPerCacheLine);
+  mTiles.clear();
+  for (size_t begin = 0; begin < numBins; begin += tileSize) {
+    mTiles.push_back(begin);
   }
-#endif
+  mTiles.push_back(numBins);
 }
 
-void Metadynamics::projectHillParallel() {
-#ifdef SUM_HILLS_USE_STD_THREAD
-  for (size_t i = 0; i < mThreads.size(); ++i) {
-    std::unique_lock<std::mutex> lk(mMutexes[i]);
-    mCondVars[i].wait(lk, [this, i](){return mTaskStates[i] == 1;});
-  }
-#endif
-#ifdef SUM_HILLS_USE_QT_CONCURRENT
-  for (int i = 0; i < mThreads.size(); ++i) {
-    mThreads[i].waitForFinished();
-  }
-#endif
+void Metadynamics::setHillCutoff(double numSigmas) {
+  mHillCutoff = numSigmas;
+}
+
+void Metadynamics::setFFT(bool enable, bool subgridSpreading) {
+  if (!enable) convolveDeposits();
+  mFFT = enable;
+  mSubgridSpreading = subgridSpreading;
 }
 
+void Metadynamics::setGradients(bool enable) {
+  if (enable == mComputeGradients) return;
+  // the hills binned for the FFT have to be convolved with the gradients
+  // in the current mode
+  convolveDeposits();
+  mComputeGradients = enable;
+  mGradients = mComputeGradients
+                   ? HistogramVector<double>(mPMF.axes(), mPMF.dimension())
+                   : HistogramVector<double>();
+}
+
+bool Metadynamics::hasGradients() const { return mComputeGradients; }
+
+void Metadynamics::projectHills(const Metadynamics::HillRef &h) {
+  if (mFFT && depositHills(h)) return;
+  mNextTile = 0;
+  mPool.run([&](size_t) {
+    const size_t numTiles = mTiles.size() - 1;
+    for (size_t i = mNextTile++; i < numTiles; i = mNextTile++) {
+      if (mComputeGradients) {
+        projectHillsOnTile<true>(mTiles[i], mTiles[i + 1], h);
+      } else {
+        projectHillsOnTile<false>(mTiles[i], mTiles[i + 1], h);
+      }
+    }
+  });
+}
+
+size_t Metadynamics::numThreads() const { return mPool.numThreads(); }
+
 size_t Metadynamics::dimension() const { return mPMF.dimension(); }
 
 const HistogramScalar<double> &Metadynamics::PMF() const { return mPMF; }
@@ -140,36 +148,516 @@ void Metadynamics::writeGradients(const HistogramVector<double> gradients,
   }
 }
 
-void Metadynamics::projectHillParallelWorker(size_t threadIndex,
-                                             const HillRef &h) {
-#ifdef SUM_HILLS_USE_STD_THREAD
-  while (mTaskStates[threadIndex] == 0 && !mShutdown) {
-    std::unique_lock<std::mutex> lk(mMutexes[threadIndex]);
-#endif
-    std::vector<double> gradients(mPMF.dimension(), 0.0);
-    double energy = 0.0;
-    const size_t stride = mThreads.size();
-    const size_t lineBufferSize = h.mActuallBufferedLines;
-    for (size_t bufferIndex = 0; bufferIndex < lineBufferSize; ++bufferIndex) {
-      for (size_t blockIndex = 0; blockIndex < mNumBlocks; ++blockIndex) {
-        const size_t i = blockIndex * stride + threadIndex;
-        if (i < mPMF.histogramSize()) {
-          h.calcEnergyAndGradient(bufferIndex, mPointMap[i], mPMF.axes(), &energy, &gradients);
-          const size_t& addr = mAddressMap[i];
-          mPMF[addr] += -1.0 * energy;
-          // mGradients shares the same axes
-          for (size_t j = 0; j < mPMF.dimension(); ++j) {
-            mGradients[addr * mPMF.dimension() + j] += -1.0 * gradients[j];
+void Metadynamics::accumulate(const Metadynamics &other) {
+  std::vector<double> &PMFData = mPMF.data();
+  const std::vector<double> &otherPMFData = other.mPMF.data();
+  for (size_t i = 0; i < PMFData.size(); ++i) {
+    PMFData[i] += otherPMFData[i];
+  }
+  std::vector<double> &gradientsData = mGradients.data();
+  const std::vector<double> &otherGradientsData = other.mGradients.data();
+  for (size_t i = 0; i < gradientsData.size(); ++i) {
+    gradientsData[i] += otherGradientsData[i];
+  }
+}
+
+void Metadynamics::resetGrids() {
+  std::fill(mPMF.data().begin(), mPMF.data().end(), 0.0);
+  std::fill(mGradients.data().begin(), mGradients.data().end(), 0.0);
+}
+
+void Metadynamics::reweightingSums(double kbT, double a, double b,
+                                   double &maxBiasResult, double &sumAResult,
+                                   double &sumBResult) {
+  // both sums are shifted by the maximum of the bias to avoid the overflow,
+  // where each thread shifts its own partial sums first
+  const double* pmf = mPMF.data().data();
+  const size_t numBins = mPMF.data().size();
+  std::vector<double> maxBias(mPool.numThreads(),
+                              std::numeric_limits<double>::lowest());
+  std::vector<double> sumA(mPool.numThreads(), 0.0);
+  std::vector<double> sumB(mPool.numThreads(), 0.0);
+  mPool.parallelFor(numBins, [&](size_t begin, size_t end, size_t tid) {
+    if (begin >= end) return;
+    double localMax = -pmf[begin];
+    for (size_t i = begin; i < end; ++i) localMax = std::max(localMax, -pmf[i]);
+    double localSumA = 0, localSumB = 0;
+    for (size_t i = begin; i < end; ++i) {
+      const double shifted = (-pmf[i] - localMax) / kbT;
+      localSumA += std::exp(a * shifted);
+      localSumB += std::exp(b * shifted);
+    }
+    maxBias[tid] = localMax;
+    sumA[tid] = localSumA;
+    sumB[tid] = localSumB;
+  });
+  const double globalMax = *std::max_element(maxBias.begin(), maxBias.end());
+  double totalA = 0, totalB = 0;
+  for (size_t t = 0; t < maxBias.size(); ++t) {
+    if (sumA[t] == 0) continue;
+    const double shift = (maxBias[t] - globalMax) / kbT;
+    totalA += sumA[t] * std::exp(a * shift);
+    totalB += sumB[t] * std::exp(b * shift);
+  }
+  maxBiasResult = globalMax;
+  sumAResult = totalA;
+  sumBResult = totalB;
+}
+
+bool Metadynamics::writeCheckpoint(const QString &filename,
+                                   const std::vector<qint64> &offsets,
+                                   qint64 lastStep) const {
+  qDebug() << "Calling" << Q_FUNC_INFO;
+  // write to a temporary file and then replace the old checkpoint, so that
+  // an interrupted run never leaves a broken checkpoint
+  QSaveFile checkpointFile(filename);
+  if (!checkpointFile.open(QIODevice::WriteOnly)) {
+    qWarning() << "Cannot write the checkpoint to" << filename;
+    return false;
+  }
+  QDataStream ofs(&checkpointFile);
+  ofs << QString("PMFToolBox sum hills checkpoint") << qint32(3);
+  ofs << quint64(dimension()) << mComputeGradients;
+  for (const auto &axis : mPMF.axes()) {
+    ofs << axis.lowerBound() << axis.upperBound() << quint64(axis.bin())
+        << axis.periodic();
+  }
+  ofs << quint64(offsets.size());
+  for (const auto &offset : offsets) ofs << offset;
+  ofs << lastStep;
+  for (const auto &x : mPMF.data()) ofs << x;
+  for (const auto &x : mGradients.data()) ofs << x;
+  if (ofs.status() != QDataStream::Ok || !checkpointFile.commit()) {
+    qWarning() << "Cannot write the checkpoint to" << filename;
+    return false;
+  }
+  return true;
+}
+
+bool Metadynamics::readCheckpoint(const QString &filename,
+                                  std::vector<qint64> &offsets,
+                                  qint64 &lastStep) {
+  qDebug() << "Calling" << Q_FUNC_INFO;
+  QFile checkpointFile(filename);
+  if (!checkpointFile.open(QIODevice::ReadOnly)) {
+    qWarning() << "Cannot read the checkpoint from" << filename;
+    return false;
+  }
+  QDataStream ifs(&checkpointFile);
+  QString magic;
+  qint32 version = 0;
+  quint64 dim = 0;
+  bool computeGradients = false;
+  ifs >> magic >> version >> dim >> computeGradients;
+  if (magic != QString("PMFToolBox sum hills checkpoint") || version != 3 ||
+      dim != dimension()) {
+    qWarning() << filename << "is not a checkpoint of the same grid.";
+    return false;
+  }
+  if (computeGradients != mComputeGradients) {
+    qWarning() << filename << (computeGradients ? "has" : "does not have")
+               << "the gradients.";
+    return false;
+  }
+  for (const auto &axis : mPMF.axes()) {
+    double lowerBound, upperBound;
+    quint64 bins;
+    bool periodic;
+    ifs >> lowerBound >> upperBound >> bins >> periodic;
+    if (!almost_equal(lowerBound, axis.lowerBound()) ||
+        !almost_equal(upperBound, axis.upperBound()) || bins != axis.bin() ||
+        periodic != axis.periodic()) {
+      qWarning() << filename << "is not a checkpoint of the same grid.";
+      return false;
+    }
+  }
+  quint64 numOffsets = 0;
+  ifs >> numOffsets;
+  if (ifs.status() != QDataStream::Ok) {
+    qWarning() << "Failed to read the checkpoint from" << filename;
+    return false;
+  }
+  std::vector<qint64> checkpointOffsets(numOffsets);
+  for (auto &offset : checkpointOffsets) ifs >> offset;
+  qint64 checkpointLastStep;
+  ifs >> checkpointLastStep;
+  std::vector<double> PMFData(mPMF.data().size());
+  std::vector<double> gradientsData(mGradients.data().size());
+  for (auto &x : PMFData) ifs >> x;
+  for (auto &x : gradientsData) ifs >> x;
+  if (ifs.status() != QDataStream::Ok) {
+    qWarning() << "Failed to read the checkpoint from" << filename;
+    return false;
+  }
+  mPMF.data() = std::move(PMFData);
+  mGradients.data() = std::move(gradientsData);
+  resetDeposits();
+  offsets = std::move(checkpointOffsets);
+  lastStep = checkpointLastStep;
+  return true;
+}
+
+void Metadynamics::hillBox(size_t j, double center, double sigma, long kBegin,
+                           long kEnd, std::vector<size_t> &box) const {
+  const Axis& axis = mPMF.axes()[j];
+  const long bins = axis.bin();
+  const double halfWidth = mHillCutoff * std::abs(sigma);
+  // the bin containing the center may be off by half a bin from the
+  // nearest bin center
+  const long n = std::ceil(halfWidth / axis.width() + 0.5);
+  if ((axis.periodic() && !axis.realPeriodic()) ||
+      (axis.realPeriodic() && 2 * n + 1 >= bins)) {
+    // a periodic axis covering part of the period, or a box wider than
+    // the axis, takes all bins
+    for (long k = kBegin; k < kEnd; ++k) box.push_back(k);
+  } else {
+    const long centerIndex = std::floor(
+      (axis.wrap(center) - axis.lowerBound()) / axis.width());
+    // the parts of a box wrapping around a periodic axis are shifted by
+    // one period
+    const long maxShift = axis.realPeriodic() ? 1 : 0;
+    for (long shift = -maxShift; shift <= maxShift; ++shift) {
+      const long first = std::max(centerIndex - n + shift * bins, kBegin);
+      const long last = std::min(centerIndex + n + shift * bins, kEnd - 1);
+      for (long k = first; k <= last; ++k) box.push_back(k);
+    }
+  }
+}
+
+void Metadynamics::binsInCutoff(const HillRef &h,
+                                std::vector<size_t> &addresses) const {
+  const size_t dim = mPMF.dimension();
+  if (dim == 0) return;
+  std::vector<std::vector<size_t>> boxIndexes(dim);
+  std::vector<size_t> odometer(dim, 0);
+  for (qint64 i = 0; i < h.mActuallBufferedLines; ++i) {
+    bool emptyBox = false;
+    for (size_t j = 0; j < dim; ++j) {
+      boxIndexes[j].clear();
+      hillBox(j, h.mCentersRef[j][i], h.mSigmasRef[j][i], 0,
+              mPMF.axes()[j].bin(), boxIndexes[j]);
+      emptyBox = emptyBox || boxIndexes[j].empty();
+    }
+    if (emptyBox) continue;
+    std::fill(odometer.begin(), odometer.end(), 0);
+    while (true) {
+      size_t addr = 0;
+      for (size_t j = 0; j < dim; ++j) {
+        addr += boxIndexes[j][odometer[j]] * mAccu[j];
+      }
+      addresses.push_back(addr);
+      size_t j = 0;
+      for (; j < dim; ++j) {
+        if (++odometer[j] < boxIndexes[j].size()) break;
+        odometer[j] = 0;
+      }
+      if (j == dim) break;
+    }
+  }
+}
+
+// the energy-only kernel is a separate instantiation without any access to
+// the gradients
+template <bool computeGradients>
+void Metadynamics::projectHillsOnTile(size_t tileBegin, size_t tileEnd,
+                                      const HillRef &h) {
+  const size_t dim = mPMF.dimension();
+  const std::vector<Axis>& axes = mPMF.axes();
+  double* pmf = mPMF.data().data();
+  double* grad = computeGradients ? mGradients.data().data() : nullptr;
+  // a Gaussian hill is a product of 1D Gaussians, so the factors and the
+  // derivatives of the logarithms of the factors are tabulated along each
+  // axis over the bins in the cutoff box of a hill
+  std::vector<std::vector<size_t>> boxIndexes(dim);
+  std::vector<std::vector<double>> factors(dim);
+  std::vector<std::vector<double>> dfactors(dim);
+  // the first index and the length of each contiguous run in the box of
+  // the first axis
+  std::vector<std::pair<size_t, size_t>> innerRuns;
+  std::vector<size_t> odometer(dim, 0);
+  if (dim == 0) return;
+  // the range of the indexes along the last axis that the tile touches
+  const size_t lastBegin = tileBegin / mAccu[dim - 1];
+  const size_t lastEnd = (tileEnd - 1) / mAccu[dim - 1] + 1;
+  const size_t lineBufferSize = h.mActuallBufferedLines;
+  for (size_t bufferIndex = 0; bufferIndex < lineBufferSize; ++bufferIndex) {
+    bool emptyBox = false;
+    // the last axis goes first since most hills miss the tile along it
+    for (size_t jj = 0; jj < dim; ++jj) {
+      const size_t j = dim - 1 - jj;
+      const Axis& axis = axes[j];
+      const long bins = axis.bin();
+      const double center = h.mCentersRef[j][bufferIndex];
+      const double sigma = h.mSigmasRef[j][bufferIndex];
+      auto& box = boxIndexes[j];
+      box.clear();
+      // only the slices along the last axis inside the tile are needed
+      const long kBegin = (j + 1 == dim) ? static_cast<long>(lastBegin) : 0;
+      const long kEnd = (j + 1 == dim) ? static_cast<long>(lastEnd) : bins;
+      hillBox(j, center, sigma, kBegin, kEnd, box);
+      if (box.empty()) {
+        emptyBox = true;
+        break;
+      }
+      const double sigma2 = sigma * sigma;
+      factors[j].resize(box.size());
+      if (computeGradients) dfactors[j].resize(box.size());
+      for (size_t t = 0; t < box.size(); ++t) {
+        const double dist = axis.dist(mMiddlePoints[j][box[t]], center);
+        factors[j][t] = std::exp(-0.5 * dist * dist / sigma2);
+        if (computeGradients) dfactors[j][t] = dist / sigma2;
+      }
+    }
+    if (emptyBox) continue;
+    // the outer product of the tables, where the first axis is the
+    // innermost loop over runs of contiguous addresses (a box wrapping
+    // around a periodic axis has two runs), which can be vectorized
+    const auto& innerBox = boxIndexes[0];
+    innerRuns.clear();
+    for (size_t t = 0; t < innerBox.size(); ++t) {
+      if (t == 0 || innerBox[t] != innerBox[t - 1] + 1) {
+        innerRuns.push_back({t, 0});
+      }
+      ++innerRuns.back().second;
+    }
+    std::fill(odometer.begin(), odometer.end(), 0);
+    while (true) {
+      size_t base = 0;
+      double outerFactor = h.mHeightsRef[bufferIndex];
+      for (size_t j = 1; j < dim; ++j) {
+        base += boxIndexes[j][odometer[j]] * mAccu[j];
+        outerFactor *= factors[j][odometer[j]];
+      }
+      for (const auto& run : innerRuns) {
+        // clip the run to the tile
+        const size_t runBegin = base + innerBox[run.first];
+        const size_t first = std::max(runBegin, tileBegin);
+        const size_t last = std::min(runBegin + run.second, tileEnd);
+        if (first >= last) continue;
+        const size_t length = last - first;
+        const size_t offset = run.first + (first - runBegin);
+        const double* f = factors[0].data() + offset;
+        double* p = pmf + first;
+        for (size_t u = 0; u < length; ++u) {
+          p[u] -= outerFactor * f[u];
+        }
+        if (!computeGradients) continue;
+        const double* df = dfactors[0].data() + offset;
+        // mGradients shares the same axes
+        double* g = grad + first * dim;
+        for (size_t u = 0; u < length; ++u) {
+          g[u * dim] += outerFactor * f[u] * df[u];
+        }
+        for (size_t j = 1; j < dim; ++j) {
+          const double outerGradient = outerFactor * dfactors[j][odometer[j]];
+          for (size_t u = 0; u < length; ++u) {
+            g[u * dim + j] += outerGradient * f[u];
           }
         }
       }
+      size_t j = 1;
+      for (; j < dim; ++j) {
+        if (++odometer[j] < boxIndexes[j].size()) break;
+        odometer[j] = 0;
+      }
+      if (j >= dim) break;
+    }
+  }
+}
+
+void Metadynamics::resetDeposits() {
+  mFixedSigmas.clear();
+  mDeposits.clear();
+  mDepositBins.clear();
+  mDepositPaddings.clear();
+  mDepositAccu.clear();
+}
+
+bool Metadynamics::depositHills(const HillRef &h) {
+  const size_t dim = mPMF.dimension();
+  const std::vector<Axis>& axes = mPMF.axes();
+  const size_t numHills = h.mActuallBufferedLines;
+  if (numHills == 0) return true;
+  if (mFixedSigmas.empty()) {
+    for (const auto& axis : axes) {
+      if (axis.periodic() && !axis.realPeriodic()) {
+        qDebug() << "The FFT cannot wrap around a part of the period, so sum "
+                    "the hills directly.";
+        mFFT = false;
+        return false;
+      }
+    }
+    mDepositBins.resize(dim);
+    mDepositPaddings.resize(dim);
+    mDepositAccu.assign(dim, 1);
+    for (size_t j = 0; j < dim; ++j) {
+      const Axis& axis = axes[j];
+      mFixedSigmas.push_back(std::abs(h.mSigmasRef[j][0]));
+      // the hills centered in the padding still reach the grid
+      const size_t n =
+        std::ceil(mHillCutoff * mFixedSigmas[j] / axis.width() + 0.5);
+      mDepositPaddings[j] = axis.realPeriodic() ? 0 : n;
+      mDepositBins[j] = axis.bin() + 2 * mDepositPaddings[j];
+      if (j > 0) mDepositAccu[j] = mDepositAccu[j - 1] * mDepositBins[j - 1];
+    }
+    mDeposits.assign(mDepositAccu[dim - 1] * mDepositBins[dim - 1], 0.0);
+  }
+  for (size_t j = 0; j < dim; ++j) {
+    for (size_t i = 0; i < numHills; ++i) {
+      if (std::abs(h.mSigmasRef[j][i]) != mFixedSigmas[j]) {
+        qDebug() << "The sigmas of the hills change, so sum the hills directly.";
+        convolveDeposits();
+        mFFT = false;
+        return false;
+      }
+    }
+  }
+  // the bins and the weights that each hill is spread to along each axis
+  std::vector<std::vector<std::pair<size_t, double>>> spread(dim);
+  std::vector<size_t> odometer(dim, 0);
+  for (size_t i = 0; i < numHills; ++i) {
+    bool outside = false;
+    for (size_t j = 0; j < dim; ++j) {
+      const Axis& axis = axes[j];
+      const long bins = axis.bin();
+      // the position in the unit of bins from the first bin center
+      const double position =
+        (axis.wrap(h.mCentersRef[j][i]) - axis.lowerBound()) / axis.width() - 0.5;
+      spread[j].clear();
+      const long first = mSubgridSpreading ? std::floor(position)
+                                           : std::floor(position + 0.5);
+      const double fraction = position - first;
+      for (long k = first; k <= first + 1; ++k) {
+        double weight = 1.0;
+        if (mSubgridSpreading) {
+          weight = (k == first) ? 1.0 - fraction : fraction;
+        } else if (k > first) {
+          break;
+        }
+        const long paddedIndex = axis.realPeriodic()
+                                     ? ((k % bins) + bins) % bins
+                                     : k + static_cast<long>(mDepositPaddings[j]);
+        if (paddedIndex >= 0 &&
+            paddedIndex < static_cast<long>(mDepositBins[j])) {
+          spread[j].push_back({paddedIndex, weight});
+        }
+      }
+      // the hill is beyond the cutoff from the grid
+      if (spread[j].empty()) {
+        outside = true;
+        break;
+      }
+    }
+    if (outside) continue;
+    std::fill(odometer.begin(), odometer.end(), 0);
+    while (true) {
+      size_t address = 0;
+      double weight = h.mHeightsRef[i];
+      for (size_t j = 0; j < dim; ++j) {
+        address += spread[j][odometer[j]].first * mDepositAccu[j];
+        weight *= spread[j][odometer[j]].second;
+      }
+      mDeposits[address] += weight;
+      size_t j = 0;
+      for (; j < dim; ++j) {
+        if (++odometer[j] < spread[j].size()) break;
+        odometer[j] = 0;
+      }
+      if (j >= dim) break;
+    }
+  }
+  return true;
+}
+
+void Metadynamics::convolveDeposits() {
+  if (std::all_of(mDeposits.begin(), mDeposits.end(),
+                  [](double x) { return x == 0; })) {
+    return;
+  }
+  qDebug() << "Calling" << Q_FUNC_INFO;
+  const size_t dim = mPMF.dimension();
+  const std::vector<Axis>& axes = mPMF.axes();
+  // the Gaussian is separable, so the N-dimensional convolution is a series
+  // of 1D convolutions along the axes, and the derivative along an axis
+  // only replaces the kernel along that axis
+  std::vector<arma::cx_vec> kernels(dim);
+  std::vector<arma::cx_vec> derivativeKernels(dim);
+  for (size_t j = 0; j < dim; ++j) {
+    const Axis& axis = axes[j];
+    const long size = mDepositBins[j];
+    const double sigma2 = mFixedSigmas[j] * mFixedSigmas[j];
+    // the same cutoff box as the direct summation
+    const long n =
+      std::ceil(mHillCutoff * mFixedSigmas[j] / axis.width() + 0.5);
+    const bool wholeAxis = axis.realPeriodic() && 2 * n + 1 >= size;
+    arma::vec kernel(size, arma::fill::zeros);
+    arma::vec derivativeKernel(size, arma::fill::zeros);
+    for (long k = 0; k < size; ++k) {
+      // the kernel is stored in the wrap-around order of the FFT
+      const long m = (k <= size / 2) ? k : k - size;
+      if (!wholeAxis && std::abs(m) > n) continue;
+      const double dist = m * axis.width();
+      kernel(k) = std::exp(-0.5 * dist * dist / sigma2);
+      derivativeKernel(k) = kernel(k) * dist / sigma2;
+    }
+    kernels[j] = arma::fft(kernel);
+    derivativeKernels[j] = arma::fft(derivativeKernel);
+  }
+  const size_t numDeposits = mDeposits.size();
+  auto convolveAlong = [&](std::vector<double> &data, size_t j,
+                           const arma::cx_vec &kernelFFT) {
+    const size_t size = mDepositBins[j];
+    const size_t numLines = numDeposits / size;
+    mPool.parallelFor(numLines, [&](size_t begin, size_t end, size_t) {
+      arma::vec line(size);
+      for (size_t l = begin; l < end; ++l) {
+        // the address of the first bin of the l-th line along axis j
+        size_t base = 0;
+        size_t remainder = l;
+        for (size_t a = 0; a < dim; ++a) {
+          if (a == j) continue;
+          base += (remainder % mDepositBins[a]) * mDepositAccu[a];
+          remainder /= mDepositBins[a];
+        }
+        for (size_t k = 0; k < size; ++k) {
+          line(k) = data[base + k * mDepositAccu[j]];
+        }
+        const arma::vec result =
+            arma::real(arma::ifft(arma::fft(line) % kernelFFT));
+        for (size_t k = 0; k < size; ++k) {
+          data[base + k * mDepositAccu[j]] = result(k);
+        }
+      }
+    });
+  };
+  // the address of each bin of the PMF in the padded grid
+  const size_t numBins = mPMF.data().size();
+  std::vector<size_t> paddedAddresses(numBins, 0);
+  for (size_t i = 0; i < numBins; ++i) {
+    for (size_t j = 0; j < dim; ++j) {
+      const size_t index = (i / mAccu[j]) % axes[j].bin();
+      paddedAddresses[i] += (index + mDepositPaddings[j]) * mDepositAccu[j];
+    }
+  }
+  double* pmf = mPMF.data().data();
+  double* grad = mGradients.data().data();
+  std::vector<double> convolved(mDeposits);
+  for (size_t j = 0; j < dim; ++j) {
+    convolveAlong(convolved, j, kernels[j]);
+  }
+  for (size_t i = 0; i < numBins; ++i) {
+    pmf[i] -= convolved[paddedAddresses[i]];
+  }
+  for (size_t k = 0; k < dim && mComputeGradients; ++k) {
+    convolved = mDeposits;
+    for (size_t j = 0; j < dim; ++j) {
+      convolveAlong(convolved, j, j == k ? derivativeKernels[j] : kernels[j]);
+    }
+    for (size_t i = 0; i < numBins; ++i) {
+      grad[i * dim + k] += convolved[paddedAddresses[i]];
     }
-#ifdef SUM_HILLS_USE_STD_THREAD
-    mTaskStates[threadIndex] = 1;
-    mCondVars[threadIndex].notify_one();
-    mCondVars[threadIndex].wait(lk, [this, threadIndex](){return mTaskStates[threadIndex] == 0;});
   }
-#endif
+  std::fill(mDeposits.begin(), mDeposits.end(), 0.0);
 }
 
 Metadynamics::HillRef::HillRef(const std::vector<std::vector<double>>& centers,
@@ -178,137 +666,543 @@ Metadynamics::HillRef::HillRef(const std::vector<std::vector<double>>& centers,
     : mCentersRef(centers), mSigmasRef(sigmas), mHeightsRef(heights),
       mActuallBufferedLines(actualBufferedLines) {}
 
-void Metadynamics::HillRef::calcEnergyAndGradient(const qint64 index,
-  const std::vector<double> &position, const std::vector<Axis> &axes,
-  double *energyPtr, std::vector<double> *gradientsPtr) const {
-  if (energyPtr) {
-    *energyPtr = 0.0;
-  } else {
+Metadynamics::HillBatch::HillBatch()
+    : mNumHills(0), mLastStep(0), mOffset(0), mAtEnd(false),
+      mPastMaxStep(false), mNextStep(0), mPartialLineEnd(-1) {}
+
+void Metadynamics::HillBatch::allocate(size_t dim, qint64 lineBufferSize) {
+  mCenters.assign(dim, std::vector<double>(lineBufferSize, 0.0));
+  mSigmas.assign(dim, std::vector<double>(lineBufferSize, 0.0));
+  mHeights.assign(lineBufferSize, 0.0);
+}
+
+void Metadynamics::readHills(QFile &trajectoryFile, HillBatch &batch,
+                             size_t dim, qint64 lineBufferSize, qint64 maxStep,
+                             bool follow) {
+  QList<QStringView> tmpFields;
+  batch.mNumHills = 0;
+  batch.mLastStep = 0;
+  batch.mAtEnd = false;
+  batch.mPastMaxStep = false;
+  batch.mPartialLineEnd = -1;
+  batch.mErrors.clear();
+  while (batch.mNumHills < lineBufferSize) {
+    const qint64 lineBegin = trajectoryFile.pos();
+    const QByteArray rawLine = trajectoryFile.readLine();
+    if (rawLine.isEmpty()) {
+      // reach EOF, break the loop
+      break;
+    }
+    if (!rawLine.endsWith('\n')) {
+      // the line may be still being written, so leave it to the next round
+      // and keep the offset after the complete lines for the checkpoint
+      if (!follow) {
+        qWarning() << "Leave the unterminated last line of"
+                   << trajectoryFile.fileName() << "unread.";
+      }
+      trajectoryFile.seek(lineBegin);
+      batch.mPartialLineEnd = lineBegin + rawLine.size();
+      batch.mAtEnd = true;
+      break;
+    }
+    const QString line = QString::fromUtf8(rawLine).trimmed();
+    splitFields(line, tmpFields);
+    // skip blank lines
+    if (tmpFields.size() <= 0)
+      continue;
+    // skip comment lines start with #
+    if (tmpFields[0].startsWith(QChar('#')))
+      continue;
+    // a metadynamics trajectory has 2N+2 columns, where N is the number of
+    // CVs
+    bool read_ok = (tmpFields.size() == static_cast<int>(2 * dim) + 2);
+    if (!read_ok) {
+      batch.mErrors.append(QString("Failed to read line:") + line);
+      continue;
+    }
+    const qint64 bufferIndex = batch.mNumHills;
+    const qint64 numStep = tmpFields[0].toLongLong(&read_ok);
+    if (read_ok && numStep > maxStep) {
+      // leave the hill to the next stride
+      trajectoryFile.seek(lineBegin);
+      batch.mPastMaxStep = true;
+      batch.mNextStep = numStep;
+      break;
+    }
+    for (size_t i = 0; i < dim && read_ok; ++i) {
+      batch.mCenters[i][bufferIndex] = tmpFields[i + 1].toDouble(&read_ok);
+      if (read_ok)
+        batch.mSigmas[i][bufferIndex] = tmpFields[dim + i + 1].toDouble(&read_ok);
+    }
+    if (read_ok)
+      batch.mHeights[bufferIndex] = tmpFields[2 * dim + 1].toDouble(&read_ok);
+    if (!read_ok) {
+      batch.mErrors.append(QString("Failed to read line:") + line);
+      continue;
+    }
+    batch.mLastStep = numStep;
+    ++batch.mNumHills;
+  }
+  batch.mOffset = trajectoryFile.pos();
+  batch.mAtEnd = batch.mAtEnd || trajectoryFile.atEnd();
+}
+
+MetadynamicsBias::MetadynamicsBias(const std::vector<Axis> &ax,
+                                   size_t numThreads)
+    : mMetaD(ax, numThreads, false), mHillsTrajectoryFile(), mStep(0),
+      mNextHillStep(std::numeric_limits<qint64>::lowest()), mAtEnd(true),
+      mWellTempered(false), mBiasTemperature(0.0), mTemperature(1.0),
+      mA(1.0), mB(0.0), mOffsetValid(false), mOffsetKbT(0.0), mOffset(0.0),
+      mMaxBias(0.0), mSumA(0.0), mSumB(0.0), mNumUpdatedBins(0) {
+  // the bias is needed after every few hills, so mMetaD sums the hills
+  // directly without the gradients
+  mBatch.allocate(mMetaD.dimension(), mLineBufferSize);
+}
+
+bool MetadynamicsBias::open(const QString &hillsTrajectoryFilename) {
+  qDebug() << "Calling" << Q_FUNC_INFO;
+  mHillsTrajectoryFile.setFileName(hillsTrajectoryFilename);
+  mAtEnd = !mHillsTrajectoryFile.open(QFile::ReadOnly);
+  return !mAtEnd;
+}
+
+void MetadynamicsBias::setHillCutoff(double numSigmas) {
+  mMetaD.setHillCutoff(numSigmas);
+  mOffsetValid = false;
+}
+
+void MetadynamicsBias::setWellTempered(bool wellTempered,
+                                       double biasTemperature,
+                                       double temperature) {
+  mWellTempered = wellTempered;
+  mBiasTemperature = biasTemperature;
+  mTemperature = temperature;
+  mA = wellTempered ? (biasTemperature + temperature) / biasTemperature : 1.0;
+  mB = wellTempered ? temperature / biasTemperature : 0.0;
+  mOffsetValid = false;
+}
+
+void MetadynamicsBias::advanceTo(qint64 step) {
+  mStep = std::max(mStep, step);
+  // a frame at the step sees the hills deposited before it
+  while (!mAtEnd && mNextHillStep < mStep) {
+    Metadynamics::readHills(mHillsTrajectoryFile, mBatch, mMetaD.dimension(),
+                            mLineBufferSize, mStep - 1);
+    for (const auto &msg : mBatch.mErrors) {
+      qWarning() << msg;
+    }
+    if (mBatch.mNumHills > 0) {
+      const Metadynamics::HillRef h(mBatch.mCenters, mBatch.mSigmas,
+                                    mBatch.mHeights, mBatch.mNumHills);
+      projectHills(h);
+    }
+    if (mBatch.mPastMaxStep) {
+      mNextHillStep = mBatch.mNextStep;
+    } else if (mBatch.mAtEnd) {
+      mAtEnd = true;
+    }
+  }
+}
+
+qint64 MetadynamicsBias::step() const { return mStep; }
+
+double MetadynamicsBias::bias(const std::vector<double> &position,
+                              bool *inGrid) const {
+  const size_t addr = mMetaD.PMF().address(position, inGrid);
+  if (inGrid != nullptr && !(*inGrid)) return 0.0;
+  return -mMetaD.PMF()[addr];
+}
+
+double MetadynamicsBias::offset(double kbT) {
+  if (!mOffsetValid || mOffsetKbT != kbT) {
+    mMetaD.reweightingSums(kbT, mA, mB, mMaxBias, mSumA, mSumB);
+    mOffset = (mA - mB) * mMaxBias + kbT * (std::log(mSumA) - std::log(mSumB));
+    mOffsetKbT = kbT;
+    mOffsetValid = true;
+    mNumUpdatedBins = 0;
+  }
+  return mOffset;
+}
+
+void MetadynamicsBias::projectHills(const Metadynamics::HillRef &h) {
+  if (!mOffsetValid) {
+    mMetaD.projectHills(h);
     return;
   }
-  if (gradientsPtr) {
-    gradientsPtr->assign(position.size(), 0.0);
-  } else {
+  // only the bins within the cutoff of the hills change, so their old terms
+  // are replaced by the new ones, while the whole grid is summed again once
+  // the updates cost as much, which also bounds the rounding errors
+  mUpdatedBins.clear();
+  mMetaD.binsInCutoff(h, mUpdatedBins);
+  std::sort(mUpdatedBins.begin(), mUpdatedBins.end());
+  mUpdatedBins.erase(std::unique(mUpdatedBins.begin(), mUpdatedBins.end()),
+                     mUpdatedBins.end());
+  mNumUpdatedBins += mUpdatedBins.size();
+  if (mNumUpdatedBins > mMetaD.PMF().data().size()) {
+    mMetaD.projectHills(h);
+    mOffsetValid = false;
     return;
   }
-  for (size_t i = 0; i < position.size(); ++i) {
-    const double dist = axes[i].dist(position[i], mCentersRef[index][i]);
-    const double dist2 = dist * dist;
-    const double sigma2 = mSigmasRef[index][i] * mSigmasRef[index][i];
-    *energyPtr += dist2 / (2.0 * sigma2);
-    (*gradientsPtr)[i] = -1.0 * dist / sigma2;
-  }
-  // magic number: reduce some expensive std::exp calculation
-  // TODO: this can be further simplified by using a neighbor list
-  if (*energyPtr < 100) {
-    *energyPtr = mHeightsRef[index] * std::exp(-1.0 * (*energyPtr));
-  } else {
-    *energyPtr = 0;
+  const double kbT = mOffsetKbT;
+  const double* pmf = mMetaD.PMF().data().data();
+  for (const size_t addr : mUpdatedBins) {
+    const double shifted = (-pmf[addr] - mMaxBias) / kbT;
+    mSumA -= std::exp(mA * shifted);
+    mSumB -= std::exp(mB * shifted);
   }
-  for (size_t i = 0; i < position.size(); ++i) {
-    (*gradientsPtr)[i] *= *energyPtr;
+  mMetaD.projectHills(h);
+  // the other bins are still below the old shift
+  double maxBias = mMaxBias;
+  for (const size_t addr : mUpdatedBins) maxBias = std::max(maxBias, -pmf[addr]);
+  mSumA *= std::exp(mA * (mMaxBias - maxBias) / kbT);
+  mSumB *= std::exp(mB * (mMaxBias - maxBias) / kbT);
+  mMaxBias = maxBias;
+  for (const size_t addr : mUpdatedBins) {
+    const double shifted = (-pmf[addr] - mMaxBias) / kbT;
+    mSumA += std::exp(mA * shifted);
+    mSumB += std::exp(mB * shifted);
+  }
+  if (mSumA > 0 && mSumB > 0) {
+    mOffset = (mA - mB) * mMaxBias + kbT * (std::log(mSumA) - std::log(mSumB));
+  } else {
+    // lost to the cancellation
+    mOffsetValid = false;
   }
 }
 
-SumHillsThread::SumHillsThread(QObject *parent) : QThread(parent), mMetaD(nullptr) {}
+SumHillsThread::SumHillsThread(QObject *parent)
+    : QThread(parent), mOutputFactor(1.0), mHillCutoff(std::sqrt(200.0)),
+      mNumThreads(0), mFollow(false), mFollowInterval(1000), mFFT(false),
+      mSubgridSpreading(true), mComputeGradients(true), mMetaD(nullptr) {}
 
 void SumHillsThread::sumHills(const std::vector<Axis> &ax, const qint64 strides,
                               const QString &HillsTrajectoryFilename) {
+  sumHills(ax, strides, QStringList{HillsTrajectoryFilename});
+}
+
+void SumHillsThread::sumHills(const std::vector<Axis> &ax, const qint64 strides,
+                              const QStringList &HillsTrajectoryFilenames) {
   qDebug() << Q_FUNC_INFO;
   QMutexLocker locker(&mutex);
   if (mMetaD != nullptr) delete mMetaD;
-  mMetaD = new Metadynamics(ax);
-  mHillsTrajectoryFilename = HillsTrajectoryFilename;
-  //  mOutputPrefix = outputPrefix;
+  // the walkers have their own threads to sum the hills
+  mMetaD = new Metadynamics(
+      ax, HillsTrajectoryFilenames.size() > 1 ? 1 : mNumThreads,
+      mComputeGradients);
+  mMetaD->setHillCutoff(mHillCutoff);
+  mMetaD->setFFT(mFFT, mSubgridSpreading);
+  mHillsTrajectoryFilenames = HillsTrajectoryFilenames;
+  mPMFLayout = std::make_shared<const HistogramScalar<double>>(ax);
+  mGradientsLayout =
+      mComputeGradients
+          ? std::make_shared<const HistogramVector<double>>(ax, ax.size())
+          : nullptr;
   mStrides = strides;
   if (!isRunning()) {
     start(LowPriority);
   }
 }
 
+void SumHillsThread::setHillCutoff(double numSigmas) {
+  QMutexLocker locker(&mutex);
+  mHillCutoff = numSigmas;
+}
+
+void SumHillsThread::setNumThreads(size_t numThreads) {
+  QMutexLocker locker(&mutex);
+  mNumThreads = numThreads;
+}
+
+void SumHillsThread::setCheckpoint(const QString &checkpointFilename) {
+  QMutexLocker locker(&mutex);
+  mCheckpointFilename = checkpointFilename;
+}
+
+void SumHillsThread::setFollow(bool follow, unsigned long interval) {
+  QMutexLocker locker(&mutex);
+  mFollow = follow;
+  mFollowInterval = interval;
+}
+
+void SumHillsThread::setFFT(bool enable, bool subgridSpreading) {
+  QMutexLocker locker(&mutex);
+  mFFT = enable;
+  mSubgridSpreading = subgridSpreading;
+}
+
+void SumHillsThread::setGradients(bool enable) {
+  QMutexLocker locker(&mutex);
+  mComputeGradients = enable;
+}
+
+void SumHillsThread::setOutput(const QString &outputPrefix, bool wellTempered,
+                               double biasTemperature, double temperature) {
+  QMutexLocker locker(&mutex);
+  mOutputPrefix = outputPrefix;
+  mOutputFactor =
+      wellTempered ? (biasTemperature + temperature) / biasTemperature : 1.0;
+}
+
 SumHillsThread::~SumHillsThread() {
+  // stop following the trajectory
+  requestInterruption();
+  wait();
   if (mMetaD != nullptr) delete mMetaD;
 }
 
+SumHillsThread::Walker::Walker(const QString &filename)
+    : mFilename(filename), mFile(filename), mMetaD(nullptr), mLastStep(0), mNumNewHills(0),
+      mAtEnd(false), mPastMaxStep(false), mNextStep(0), mOffset(0),
+      mPartialLineEnd(-1) {}
+
+void SumHillsThread::sumWalkerHills(Walker &walker, qint64 maxStep) const {
+  const qint64 lineBufferSize = mLineBufferSize;
+  walker.mNumNewHills = 0;
+  walker.mErrors.clear();
+  const size_t dim = mMetaD->dimension();
+  Metadynamics::readHills(walker.mFile, walker.mBatches[0], dim,
+                          lineBufferSize, maxStep, mFollow);
+  for (size_t current = 0;; current = 1 - current) {
+    const Metadynamics::HillBatch &batch = walker.mBatches[current];
+    Metadynamics::HillBatch &nextBatch = walker.mBatches[1 - current];
+    std::future<void> nextRead;
+    if (!batch.mAtEnd && !batch.mPastMaxStep) {
+      // read the next batch in another thread while summing the hills of
+      // the current one
+      nextRead = std::async(std::launch::async, &Metadynamics::readHills,
+                            std::ref(walker.mFile), std::ref(nextBatch), dim,
+                            lineBufferSize, maxStep, mFollow);
+    }
+    walker.mErrors.append(batch.mErrors);
+    const Metadynamics::HillRef h(batch.mCenters, batch.mSigmas,
+                                  batch.mHeights, batch.mNumHills);
+    walker.mMetaD->projectHills(h);
+    walker.mNumNewHills += batch.mNumHills;
+    if (batch.mNumHills > 0) walker.mLastStep = batch.mLastStep;
+    walker.mOffset = batch.mOffset;
+    walker.mAtEnd = batch.mAtEnd;
+    walker.mPastMaxStep = batch.mPastMaxStep;
+    walker.mNextStep = batch.mNextStep;
+    walker.mPartialLineEnd = batch.mPartialLineEnd;
+    if (!nextRead.valid()) break;
+    nextRead.get();
+  }
+}
+
+void SumHillsThread::reduceWalkers(
+    std::vector<std::unique_ptr<Walker>> &walkers) {
+  const size_t numWalkers = walkers.size();
+  for (auto &walker : walkers) {
+    walker->mMetaD->convolveDeposits();
+  }
+  if (numWalkers <= 1) return;
+  // add the grids pairwise, where the pairs at each level run in parallel
+  for (size_t stride = 1; stride < numWalkers; stride *= 2) {
+    std::vector<std::future<void>> pairs;
+    for (size_t i = 0; i + stride < numWalkers; i += 2 * stride) {
+      pairs.push_back(std::async(std::launch::async, [&, i, stride]() {
+        walkers[i]->mMetaD->accumulate(*(walkers[i + stride]->mMetaD));
+      }));
+    }
+    for (auto &pair : pairs) pair.get();
+  }
+  mMetaD->accumulate(*(walkers[0]->mMetaD));
+  for (auto &walker : walkers) {
+    walker->mMetaD->resetGrids();
+  }
+}
+
+void SumHillsThread::writeSnapshot(const QString &outputPrefix) {
+  if (mOutputPrefix.isEmpty()) return;
+  // the buffers are recycled from the previous snapshots, so that copying
+  // the grids neither allocates nor waits for the writer
+  std::vector<double> PMFData = mWriter.buffer();
+  PMFData.assign(mMetaD->PMF().data().begin(), mMetaD->PMF().data().end());
+  mWriter.write(mPMFLayout, std::move(PMFData), outputPrefix + ".pmf",
+                mOutputFactor);
+  if (mComputeGradients) {
+    std::vector<double> gradientsData = mWriter.buffer();
+    gradientsData.assign(mMetaD->gradients().data().begin(),
+                         mMetaD->gradients().data().end());
+    mWriter.write(mGradientsLayout, std::move(gradientsData),
+                  outputPrefix + ".grad", mOutputFactor);
+  }
+}
+
 void SumHillsThread::run() {
   qDebug() << Q_FUNC_INFO;
   mutex.lock();
-  QFile trajectoryFile(mHillsTrajectoryFilename);
-  const QRegularExpression split_regex("[(),\\s]+");
-  qDebug() << "Reading file:" << mHillsTrajectoryFilename;
+  qDebug() << "Reading files:" << mHillsTrajectoryFilenames;
   QElapsedTimer timer;
   timer.start();
-  if (trajectoryFile.open(QFile::ReadOnly)) {
-    const double fileSize = trajectoryFile.size();
-    QTextStream ifs(&trajectoryFile);
-    QString line;
-    QList<QStringView> tmpFields;
-    double readSize = 0;
+  const size_t numWalkers = mHillsTrajectoryFilenames.size();
+  std::vector<std::unique_ptr<Walker>> walkers;
+  bool open_ok = numWalkers > 0;
+  for (const auto &filename : mHillsTrajectoryFilenames) {
+    walkers.push_back(std::make_unique<Walker>(filename));
+    if (!walkers.back()->mFile.open(QFile::ReadOnly)) {
+      emit error(QString("Cannot open file") + filename);
+      open_ok = false;
+    }
+  }
+  if (open_ok) {
+    // the FFT falls back to the direct summation with its own message
+    if (!mFFT) {
+      qDebug() << "Sum the hills directly.";
+    } else if (mSubgridSpreading) {
+      qDebug() << "Sum the hills by FFT with the subgrid spreading.";
+    } else {
+      qDebug() << "Sum the hills by FFT without the subgrid spreading.";
+    }
+    const size_t numThreads =
+        mNumThreads > 0 ? mNumThreads : ThreadPool::defaultNumThreads();
+    for (auto &walker : walkers) {
+      if (numWalkers > 1) {
+        walker->mPrivateMetaD = std::make_unique<Metadynamics>(
+            mMetaD->PMF().axes(), std::max(numThreads / numWalkers, size_t(1)),
+            mComputeGradients);
+        walker->mPrivateMetaD->setHillCutoff(mHillCutoff);
+        walker->mPrivateMetaD->setFFT(mFFT, mSubgridSpreading);
+        walker->mMetaD = walker->mPrivateMetaD.get();
+      } else {
+        walker->mMetaD = mMetaD;
+      }
+      for (auto &batch : walker->mBatches) {
+        batch.allocate(mMetaD->dimension(), mLineBufferSize);
+      }
+    }
+    qint64 lastStep = 0;
+    if (!mCheckpointFilename.isEmpty() && QFile::exists(mCheckpointFilename)) {
+      std::vector<qint64> offsets;
+      if (mMetaD->readCheckpoint(mCheckpointFilename, offsets, lastStep)) {
+        bool offsets_ok = offsets.size() == numWalkers;
+        for (size_t i = 0; i < numWalkers && offsets_ok; ++i) {
+          offsets_ok = offsets[i] <= walkers[i]->mFile.size();
+        }
+        if (offsets_ok) {
+          qDebug() << "Resume from step" << lastStep;
+          for (size_t i = 0; i < numWalkers; ++i) {
+            walkers[i]->mFile.seek(offsets[i]);
+            walkers[i]->mOffset = offsets[i];
+            walkers[i]->mLastStep = lastStep;
+          }
+        } else {
+          qWarning() << "The trajectories do not match the checkpoint,"
+                     << "sum all hills again.";
+          mMetaD->resetGrids();
+          lastStep = 0;
+        }
+      }
+    }
     qint64 previousProgress = 0;
-    bool read_ok = true;
-    // use buffered reading
-    qint64 lineBufferSize = mLineBufferSize;
-    qint64 actualBufferedLine = 0;
-    if (mStrides > 0) {
-      // currently buffered reading is incompatible with strides
-      lineBufferSize = 1;
-    }
-    std::vector<std::vector<double>> centers(
-      lineBufferSize, std::vector<double>(mMetaD->dimension(), 0.0));
-    std::vector<std::vector<double>> sigmas(
-      lineBufferSize, std::vector<double>(mMetaD->dimension(), 0.0));
-    std::vector<double> heights(lineBufferSize, 0.0);
-    const Metadynamics::HillRef h(centers, sigmas, heights, actualBufferedLine);
-    while (!ifs.atEnd()) {
-      qint64 numStep = 0;
-      actualBufferedLine = 0;
-      for (qint64 bufferIndex = 0; bufferIndex < lineBufferSize; ++bufferIndex) {
-        if (!ifs.readLineInto(&line)) {
-          // reach EOF, break the loop
-          break;
+    auto reportProgress = [&]() {
+      double readSize = 0, fileSize = 0;
+      for (const auto &walker : walkers) {
+        readSize += walker->mOffset;
+        // mFile may be read concurrently by sumWalkerHills
+        fileSize += QFileInfo(walker->mFilename).size();
+      }
+      const qint64 readingProgress =
+          fileSize > 0 ? std::nearbyint(readSize / fileSize * 100) : 100;
+      if (readingProgress - previousProgress >= refreshPeriod ||
+          (readingProgress == 100 && previousProgress != 100)) {
+        previousProgress = readingProgress;
+        emit progress(readingProgress);
+      }
+    };
+    // the hills are summed stride by stride, so that the strided results of
+    // all walkers are aligned by the step
+    const qint64 noMaxStep = std::numeric_limits<qint64>::max();
+    qint64 maxStep =
+        mStrides > 0 ? (lastStep / mStrides + 1) * mStrides : noMaxStep;
+    qint64 numHillsInStride = 0;
+    while (true) {
+      qint64 numNewHills = 0;
+      while (true) {
+        std::vector<std::future<void>> sums;
+        for (auto &walker : walkers) {
+          sums.push_back(std::async(std::launch::async,
+                                    &SumHillsThread::sumWalkerHills, this,
+                                    std::ref(*walker), maxStep));
         }
-        ++actualBufferedLine;
-        readSize += line.size() + 1;
-        const int readingProgress = std::nearbyint(readSize / fileSize * 100);
-        if (readingProgress % refreshPeriod == 0 || readingProgress == 100) {
-          if (previousProgress != readingProgress) {
-            previousProgress = readingProgress;
-            emit progress(readingProgress);
+        for (auto &sum : sums) {
+          while (sum.wait_for(std::chrono::milliseconds(200)) !=
+                 std::future_status::ready) {
+            reportProgress();
+          }
+          sum.get();
+        }
+        reportProgress();
+        bool pastMaxStep = false;
+        qint64 nextStep = noMaxStep;
+        for (auto &walker : walkers) {
+          for (const auto &msg : walker->mErrors) {
+            emit error(msg);
+          }
+          numNewHills += walker->mNumNewHills;
+          numHillsInStride += walker->mNumNewHills;
+          lastStep = std::max(lastStep, walker->mLastStep);
+          if (walker->mPastMaxStep) {
+            pastMaxStep = true;
+            nextStep = std::min(nextStep, walker->mNextStep);
           }
         }
-        QStringView line_view(line);
-        tmpFields = line_view.split(split_regex, Qt::SkipEmptyParts);
-        // skip blank lines
-        if (tmpFields.size() <= 0)
-          continue;
-        // skip comment lines start with #
-        if (tmpFields[0].startsWith(QChar('#')))
-          continue;
-        // a metadynamics trajectory has 2N+2 columns, where N is the number of
-        // CVs
-        read_ok = read_ok && (tmpFields.size() ==
-                              static_cast<int>(2 * mMetaD->dimension()) + 2);
-        numStep = tmpFields[0].toLongLong(&read_ok);
-        for (size_t i = 0; i < mMetaD->dimension(); ++i) {
-          centers[bufferIndex][i] = tmpFields[i + 1].toDouble(&read_ok);
-          sigmas[bufferIndex][i] = tmpFields[mMetaD->dimension() + i + 1].toDouble(&read_ok);
+        if (mStrides <= 0) break;
+        // the stride is complete if any walker has gone past it, or if the
+        // last hill is exactly at its end
+        if (pastMaxStep || lastStep == maxStep) {
+          if (numHillsInStride > 0) {
+            reduceWalkers(walkers);
+            writeSnapshot(mOutputPrefix + "_" + QString::number(maxStep));
+            emit stridedResult(maxStep);
+            numHillsInStride = 0;
+          }
+          // skip the strides without any hills
+          const qint64 next = pastMaxStep ? nextStep : lastStep + 1;
+          maxStep = std::max(maxStep + mStrides,
+                             (next + mStrides - 1) / mStrides * mStrides);
         }
-        heights[bufferIndex] = tmpFields[2 * mMetaD->dimension() + 1].toDouble(&read_ok);
-        if (!read_ok) {
-          emit error(QString("Failed to read line:") + line);
+        if (!pastMaxStep) break;
+      }
+      reduceWalkers(walkers);
+      if (!mCheckpointFilename.isEmpty() && numNewHills > 0) {
+        std::vector<qint64> offsets;
+        for (const auto &walker : walkers) {
+          offsets.push_back(walker->mFile.pos());
         }
+        mMetaD->writeCheckpoint(mCheckpointFilename, offsets, lastStep);
+      }
+      if (!mFollow) break;
+      if (numNewHills > 0) {
+        writeSnapshot(mOutputPrefix);
+        emit updated(lastStep);
       }
-      mMetaD->launchThreads(h);
-      mMetaD->projectHillParallel();
-      if (numStep > 0 && mStrides > 0 && (numStep % mStrides == 0)) {
-        emit stridedResult(numStep, mMetaD->PMF(), mMetaD->gradients());
+      // wait for new hills in any of the trajectories, where a partial last
+      // line left unread has to grow before reading it again
+      bool hasNewHills = false;
+      while (!isInterruptionRequested() && !hasNewHills) {
+        for (const auto &walker : walkers) {
+          const qint64 size = walker->mFile.size();
+          if (size < walker->mFile.pos()) {
+            qWarning() << "The trajectory" << walker->mFile.fileName()
+                       << "is truncated, stop following.";
+            requestInterruption();
+          }
+          const qint64 readEnd = walker->mPartialLineEnd >= 0
+                                     ? walker->mPartialLineEnd
+                                     : walker->mFile.pos();
+          hasNewHills = hasNewHills || size > readEnd;
+        }
+        if (!hasNewHills && !isInterruptionRequested())
+          QThread::msleep(mFollowInterval);
       }
+      if (isInterruptionRequested()) break;
     }
-  } else {
-    emit error(QString("Cannot open file") + mHillsTrajectoryFilename);
   }
+  writeSnapshot(mOutputPrefix);
+  mWriter.flush();
   qDebug() << "The summation of metadynamics hills takes" << timer.elapsed()
            << "ms.";
-  emit done(mMetaD->PMF(), mMetaD->gradients());
+  emit done();
   mutex.unlock();
 }
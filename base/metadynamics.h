@@ -4,31 +4,27 @@
 #include "base/common.h"
 #include "base/helper.h"
 #include "base/histogram.h"
+#include "base/histogramwriter.h"
+#include "base/threadpool.h"
 
-//#define SUM_HILLS_USE_QT_CONCURRENT
-#define SUM_HILLS_USE_STD_THREAD
-
-#ifdef SUM_HILLS_USE_STD_THREAD
-#include <tuple>
-#include <thread>
-#include <condition_variable>
-#include <mutex>
-#endif
-#ifdef SUM_HILLS_USE_QT_CONCURRENT
-#include <QFuture>
-#include <QtConcurrent/QtConcurrent>
-#endif
+#include <atomic>
+#include <memory>
 #include <vector>
 #include <QObject>
 #include <QThread>
 #include <QMutex>
 #include <QList>
 #include <QString>
+#include <QStringList>
+#include <QFile>
 
 
 class Metadynamics
 {
 public:
+  // the buffered hills in the structure-of-arrays layout, where the center
+  // and the sigma of the i-th hill along the j-th axis are centers[j][i] and
+  // sigmas[j][i]
   class HillRef {
   public:
     HillRef(const std::vector<std::vector<double>>& centers,
@@ -39,46 +35,176 @@ public:
     const std::vector<std::vector<double>>& mSigmasRef;
     const std::vector<double>& mHeightsRef;
     const qint64& mActuallBufferedLines;
-    void calcEnergyAndGradient(
-      const qint64 index, const std::vector<double>& position,
-      const std::vector<Axis>& axes, double* energyPtr = nullptr,
-      std::vector<double>* gradientsPtr = nullptr) const;
   };
-#ifdef SUM_HILLS_USE_QT_CONCURRENT
-  Metadynamics(size_t numThreads = QThread::idealThreadCount() - 1);
-  Metadynamics(const std::vector<Axis>& ax, size_t numThreads = QThread::idealThreadCount() - 1);
-#endif
-#ifdef SUM_HILLS_USE_STD_THREAD
-  Metadynamics(size_t numThreads = std::thread::hardware_concurrency() - 1);
-  Metadynamics(const std::vector<Axis>& ax, size_t numThreads = std::thread::hardware_concurrency() - 1);
-#endif
+  // a batch of hills read from a trajectory in the layout of HillRef
+  struct HillBatch {
+    HillBatch();
+    // allocate the buffers of lineBufferSize hills
+    void allocate(size_t dim, qint64 lineBufferSize);
+    std::vector<std::vector<double>> mCenters;
+    std::vector<std::vector<double>> mSigmas;
+    std::vector<double> mHeights;
+    qint64 mNumHills;
+    // the step of the last hill
+    qint64 mLastStep;
+    // the position in the file after reading the batch
+    qint64 mOffset;
+    bool mAtEnd;
+    // the batch stops before a hill after the maximum step
+    bool mPastMaxStep;
+    qint64 mNextStep;
+    // the end of the data in the file when a partial last line is left
+    // unread, or -1 without such a line
+    qint64 mPartialLineEnd;
+    QStringList mErrors;
+  };
+  // read at most lineBufferSize hills of dim CVs up to maxStep, where a
+  // partial last line without the newline is always left in the file for the
+  // next read, and reported by a warning unless follow is set
+  static void readHills(QFile& trajectoryFile, HillBatch& batch, size_t dim,
+                        qint64 lineBufferSize, qint64 maxStep,
+                        bool follow = false);
+  // numThreads == 0 uses ThreadPool::defaultNumThreads(), and the gradients
+  // are only allocated if computeGradients is set (see setGradients)
+  Metadynamics(size_t numThreads = 0, bool computeGradients = true);
+  Metadynamics(const std::vector<Axis>& ax, size_t numThreads = 0,
+               bool computeGradients = true);
   ~Metadynamics();
   void setupHistogram(const std::vector<Axis>& ax);
-  void launchThreads(const HillRef& h);
-  void projectHillParallel();
+  // each hill is only summed over the bins within numSigmas sigmas from its
+  // center along each axis
+  void setHillCutoff(double numSigmas);
+  // sum the hills with the same sigmas by binning their heights on the grid
+  // and convolving the bins with the Gaussian by FFT, which falls back to
+  // the direct summation after the first hill with different sigmas, and
+  // optionally spread each height linearly to the neighboring bins
+  void setFFT(bool enable, bool subgridSpreading = true);
+  // compute the gradients along with the PMF, or skip them and leave the
+  // gradients empty if only the PMF is needed
+  void setGradients(bool enable);
+  bool hasGradients() const;
+  // add the buffered hills to the PMF and the gradients, and return after
+  // all threads are done
+  void projectHills(const HillRef& h);
+  // append the addresses of the bins within the cutoff of each hill, where
+  // a bin shared by several hills appears more than once
+  void binsInCutoff(const HillRef& h, std::vector<size_t>& addresses) const;
+  // add the hills binned for the FFT mode to the PMF and the gradients,
+  // which has to be called before reading the results
+  void convolveDeposits();
+  size_t numThreads() const;
   size_t dimension() const;
   const HistogramScalar<double>& PMF() const;
   const HistogramVector<double>& gradients() const;
+  // add the PMF and the gradients of another instance on the same grid
+  void accumulate(const Metadynamics& other);
+  // set the PMF and the gradients to zero
+  void resetGrids();
+  // the maximum of the bias V = -PMF and the sums of
+  // exp(a (V(s) - maxBias) / kbT) and exp(b (V(s) - maxBias) / kbT) over the
+  // grid (see MetadynamicsBias::offset)
+  void reweightingSums(double kbT, double a, double b, double& maxBias,
+                       double& sumA, double& sumB);
+  // save the accumulated PMF and gradients along with the offsets in the
+  // trajectories and the step of the last hill read, so that a later run can
+  // resume
+  bool writeCheckpoint(const QString& filename,
+                       const std::vector<qint64>& offsets,
+                       qint64 lastStep) const;
+  // restore the accumulated PMF and gradients, which requires the same axes
+  bool readCheckpoint(const QString& filename, std::vector<qint64>& offsets,
+                      qint64& lastStep);
   static void writePMF(const HistogramScalar<double>& PMF, const QString& filename, bool wellTempered, double biasTemperature, double temperature);
   static void writeGradients(const HistogramVector<double> gradients, const QString& filename, bool wellTempered, double biasTemperature, double temperature);
 private:
-  void projectHillParallelWorker(size_t threadIndex, const HillRef &h);
-#ifdef SUM_HILLS_USE_STD_THREAD
-  std::vector<std::thread> mThreads;
-  std::vector<std::condition_variable> mCondVars;
-  std::vector<std::mutex> mMutexes;
-  std::vector<int> mTaskStates;
-  bool mFirstTime;
-  bool mShutdown;
-#endif
-#ifdef SUM_HILLS_USE_QT_CONCURRENT
-  QVector<QFuture<void>> mThreads;
-#endif
-  size_t mNumBlocks;
+  void setupTiles();
+  // append the indexes in [kBegin, kEnd) along the j-th axis within the
+  // cutoff of a hill to box
+  void hillBox(size_t j, double center, double sigma, long kBegin, long kEnd,
+               std::vector<size_t>& box) const;
+  // add the buffered hills to the bins with addresses in [tileBegin, tileEnd)
+  template <bool computeGradients>
+  void projectHillsOnTile(size_t tileBegin, size_t tileEnd, const HillRef &h);
+  // bin the heights of the hills, or return false if any of them has sigmas
+  // different from the previous hills
+  bool depositHills(const HillRef &h);
+  void resetDeposits();
+  ThreadPool mPool;
+  double mHillCutoff;
+  bool mComputeGradients;
   HistogramScalar<double> mPMF;
   HistogramVector<double> mGradients;
-  std::vector<std::vector<double>> mPointMap;
-  std::vector<size_t> mAddressMap;
+  // the bin centers along each axis
+  std::vector<std::vector<double>> mMiddlePoints;
+  std::vector<size_t> mAccu;
+  // the bins are divided into contiguous tiles of addresses, where the i-th
+  // tile is [mTiles[i], mTiles[i+1]), and the threads take the tiles one by
+  // one so that no two threads write to the same bin
+  std::vector<size_t> mTiles;
+  std::atomic<size_t> mNextTile;
+  bool mFFT;
+  bool mSubgridSpreading;
+  // the sigmas shared by all hills in the FFT mode, which is empty before
+  // the first hill
+  std::vector<double> mFixedSigmas;
+  // the binned heights on the grid padded by the cutoff of the hills along
+  // the non-periodic axes to avoid the wrap-around of the FFT
+  std::vector<double> mDeposits;
+  std::vector<size_t> mDepositBins;
+  std::vector<size_t> mDepositPaddings;
+  std::vector<size_t> mDepositAccu;
+};
+
+// The bias of a metadynamics run as it evolves with the step, which sums the
+// hills from the trajectory incrementally as the step advances
+class MetadynamicsBias {
+public:
+  MetadynamicsBias(const std::vector<Axis>& ax, size_t numThreads = 0);
+  bool open(const QString& hillsTrajectoryFilename);
+  void setHillCutoff(double numSigmas);
+  // the temperatures in the exponents of c(t) (see offset)
+  void setWellTempered(bool wellTempered, double biasTemperature,
+                       double temperature);
+  // sum the hills deposited before the step, which cannot go backwards
+  void advanceTo(qint64 step);
+  qint64 step() const;
+  // the bias V(s,t) at the position, or false in inGrid outside the grid
+  double bias(const std::vector<double>& position, bool* inGrid) const;
+  // c(t) = kbT ln(sum_s exp(a V(s) / kbT) / sum_s exp(b V(s) / kbT)) of the
+  // time-dependent reweighting by Tiwary and Parrinello, where V is the
+  // current bias, a = (biasTemperature + temperature) / biasTemperature and
+  // b = temperature / biasTemperature for a well-tempered run, and a = 1 and
+  // b = 0 otherwise. The sums are updated over the bins within the cutoff of
+  // the new hills, and summed over the whole grid again only after as many
+  // bins as the grid has are updated.
+  double offset(double kbT);
+private:
+  // add the hills to the bias and update the sums of c(t) if they are valid
+  void projectHills(const Metadynamics::HillRef& h);
+  Metadynamics mMetaD;
+  QFile mHillsTrajectoryFile;
+  Metadynamics::HillBatch mBatch;
+  qint64 mStep;
+  // the step of the next hill in the trajectory that is not summed yet
+  qint64 mNextHillStep;
+  bool mAtEnd;
+  bool mWellTempered;
+  double mBiasTemperature;
+  double mTemperature;
+  // the exponents in c(t) (see offset)
+  double mA;
+  double mB;
+  bool mOffsetValid;
+  double mOffsetKbT;
+  double mOffset;
+  // the sums of c(t) at mOffsetKbT shifted by mMaxBias, which stays an upper
+  // bound of the bias between two summations over the whole grid
+  double mMaxBias;
+  double mSumA;
+  double mSumB;
+  size_t mNumUpdatedBins;
+  std::vector<size_t> mUpdatedBins;
+  static const qint64 mLineBufferSize = 20000;
 };
 
 class SumHillsThread: public QThread {
@@ -87,19 +213,86 @@ public:
   SumHillsThread(QObject *parent = nullptr);
   void sumHills(const std::vector<Axis>& ax, const qint64 strides,
                 const QString& HillsTrajectoryFilename);
+  // sum the hills of multiple walkers, one trajectory per walker
+  void sumHills(const std::vector<Axis>& ax, const qint64 strides,
+                const QStringList& HillsTrajectoryFilenames);
+  void setHillCutoff(double numSigmas);
+  // numThreads == 0 uses ThreadPool::defaultNumThreads()
+  void setNumThreads(size_t numThreads);
+  // resume from the checkpoint if it exists, and update it after reading
+  // the trajectory
+  void setCheckpoint(const QString& checkpointFilename);
+  // keep watching the trajectory for new hills every interval milliseconds
+  // until the thread is interrupted
+  void setFollow(bool follow, unsigned long interval = 1000);
+  // use the FFT while all hills have the same sigmas (see Metadynamics::setFFT),
+  // which is off by default since it approximates the off-center hills
+  void setFFT(bool enable, bool subgridSpreading = true);
+  // emit empty gradients if disabled (see Metadynamics::setGradients)
+  void setGradients(bool enable);
+  // write the results to outputPrefix.pmf and outputPrefix.grad, and the
+  // strided results to outputPrefix_<step>.pmf and outputPrefix_<step>.grad,
+  // in a background thread, where an empty prefix writes nothing
+  void setOutput(const QString& outputPrefix, bool wellTempered = false,
+                 double biasTemperature = 0.0, double temperature = 1.0);
   ~SumHillsThread();
 signals:
-  void done(HistogramScalar<double> PMFresult, HistogramVector<double> GradientsResult);
-  void stridedResult(qint64 step, HistogramScalar<double> PMFresult, HistogramVector<double> GradientsResult);
+  // emitted after all results are written
+  void done();
+  // the strided result at the step is queued for writing
+  void stridedResult(qint64 step);
+  // the result after summing the newly appended hills in the follow mode is
+  // queued for writing
+  void updated(qint64 step);
   void progress(qint64 percent);
   void error(QString msg);
 protected:
   void run() override;
 private:
+  // a walker sums the hills of its trajectory into its own grids
+  struct Walker {
+    Walker(const QString& filename);
+    // kept apart from mFile that is used by the reading thread
+    const QString mFilename;
+    QFile mFile;
+    Metadynamics* mMetaD;
+    // the private grids of this walker if there are multiple walkers
+    std::unique_ptr<Metadynamics> mPrivateMetaD;
+    Metadynamics::HillBatch mBatches[2];
+    qint64 mLastStep;
+    qint64 mNumNewHills;
+    bool mAtEnd;
+    bool mPastMaxStep;
+    qint64 mNextStep;
+    std::atomic<qint64> mOffset;
+    // see HillBatch::mPartialLineEnd
+    qint64 mPartialLineEnd;
+    QStringList mErrors;
+  };
+  // sum the hills of a walker up to the maximum step or the end of file
+  void sumWalkerHills(Walker& walker, qint64 maxStep) const;
+  // add the grids of all walkers to mMetaD by a tree reduction
+  void reduceWalkers(std::vector<std::unique_ptr<Walker>>& walkers);
+  // hand a copy of the current grids to the writer
+  void writeSnapshot(const QString& outputPrefix);
   QMutex mutex;
-  QString mHillsTrajectoryFilename;
-//  QString mOutputPrefix;
+  QStringList mHillsTrajectoryFilenames;
+  QString mOutputPrefix;
+  // the well-tempered factor of the written PMF and gradients
+  double mOutputFactor;
+  HistogramWriter mWriter;
+  // the grids shared with the writer as the layout of the snapshots
+  std::shared_ptr<const HistogramScalar<double>> mPMFLayout;
+  std::shared_ptr<const HistogramVector<double>> mGradientsLayout;
   qint64 mStrides;
+  double mHillCutoff;
+  size_t mNumThreads;
+  QString mCheckpointFilename;
+  bool mFollow;
+  unsigned long mFollowInterval;
+  bool mFFT;
+  bool mSubgridSpreading;
+  bool mComputeGradients;
   Metadynamics* mMetaD;
   static const qint64 mLineBufferSize = 20000;
   static const int refreshPeriod = 5;
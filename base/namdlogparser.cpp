@@ -18,6 +18,10 @@
 */
 
 #include "namdlogparser.h"
+#include "base/helper.h"
+#include "base/threadpool.h"
+
+#include <atomic>
 
 NAMDLog::NAMDLog() {}
 
@@ -243,6 +247,25 @@ void BinNAMDLogThread::invokeThread(const NAMDLog &log,
   }
 }
 
+// whether the bytes [begin, end) are neither a blank line nor a comment line
+// after splitting by splitFields
+static bool isDataLine(const char *begin, const char *end) {
+  for (; begin != end; ++begin) {
+    const QChar c{QLatin1Char(*begin)};
+    if (c.isSpace() || c == u'(' || c == u')' || c == u',')
+      continue;
+    return c != u'#';
+  }
+  return false;
+}
+
+static void addHistogramData(std::vector<double> &to,
+                             const std::vector<double> &from) {
+  for (size_t i = 0; i < to.size(); ++i) {
+    to[i] += from[i];
+  }
+}
+
 void BinNAMDLogThread::run() {
   qDebug() << Q_FUNC_INFO;
   mutex.lock();
@@ -250,77 +273,170 @@ void BinNAMDLogThread::run() {
       mEnergyTitle.size(), HistogramScalar<double>(mAxes));
   std::vector<HistogramVector<double>> histForce(
       mForceTitle.size(), HistogramVector<double>(mAxes, 3));
-  std::vector<doBinningScalar> energyBinning;
-  std::vector<doBinningVector> forceBinning;
+  HistogramScalar<double> histCount(mAxes);
+  // look up the log data of the titles only once
+  std::vector<const std::vector<double> *> energyData(mEnergyTitle.size(),
+                                                      nullptr);
+  std::vector<const std::vector<ForceType> *> forceData(mForceTitle.size(),
+                                                        nullptr);
   for (int i = 0; i < mEnergyTitle.size(); ++i) {
-    energyBinning.push_back(doBinningScalar(histEnergy[i], mColumns));
+    const auto map_iterator = mLog.getEnergyDataIterator(mEnergyTitle[i]);
+    if (map_iterator != mLog.getEnergyDataIteratorEnd()) {
+      energyData[i] = &map_iterator.value();
+    }
   }
   for (int i = 0; i < mForceTitle.size(); ++i) {
-    forceBinning.push_back(doBinningVector(histForce[i], mColumns));
+    const auto map_iterator = mLog.getForceDataIterator(mForceTitle[i]);
+    if (map_iterator != mLog.getForceDataIteratorEnd()) {
+      forceData[i] = &map_iterator.value();
+    }
   }
-  HistogramScalar<double> histCount(mAxes);
-  doBinningScalar countBinning(histCount, mColumns);
   // parse the trajectory file
-  const QRegularExpression split_regex("[(),\\s]+");
   QFile trajFile(mTrajectoryFileName);
   if (trajFile.open(QIODevice::ReadOnly)) {
-    QTextStream ifs_traj(&trajFile);
-    QList<QStringView> tmpFields;
-    size_t lineNumber = 0;
-    QString line;
-    double readSize = 0;
-    int previousProgress = 0;
-    bool read_ok = true;
-    const size_t fileSize = trajFile.size();
-    while (!ifs_traj.atEnd()) {
-      ifs_traj.readLineInto(&line);
-      readSize += line.size() + 1;
-      const int readingProgress = std::nearbyint(readSize / fileSize * 100);
-      if (readingProgress % refreshPeriod == 0 || readingProgress == 100) {
-        if (previousProgress != readingProgress) {
-          previousProgress = readingProgress;
-          qDebug() << Q_FUNC_INFO << "reading " << readingProgress << "%";
-          emit progress("Reading trajectory file", readingProgress);
+    // map the file into memory, or read all of it if it cannot be mapped
+    qint64 fileSize = trajFile.size();
+    const char *data = nullptr;
+    QByteArray fileContent;
+    if (fileSize > 0) {
+      data = reinterpret_cast<const char *>(trajFile.map(0, fileSize));
+    }
+    if (data == nullptr) {
+      fileContent = trajFile.readAll();
+      data = fileContent.constData();
+      fileSize = fileContent.size();
+    }
+    // the workers take the ranges of whole lines one by one, and the data
+    // lines before each range are counted first to find the frames in the log
+    ThreadPool pool(ThreadPool::defaultNumThreads());
+    const size_t numThreads = pool.numThreads();
+    const std::vector<qint64> boundaries = splitLineRanges(
+        data, fileSize,
+        std::max(numThreads, size_t((fileSize + rangeBytes - 1) / rangeBytes)));
+    const size_t numRanges = boundaries.size() - 1;
+    std::vector<size_t> firstLineNumber(numRanges + 1, 0);
+    std::atomic<size_t> nextRange(0);
+    pool.run([&](size_t) {
+      for (size_t i = nextRange++; i < numRanges; i = nextRange++) {
+        size_t numLines = 0;
+        const char *lineBegin = data + boundaries[i];
+        const char *rangeEnd = data + boundaries[i + 1];
+        while (lineBegin < rangeEnd) {
+          const char *lineEnd = static_cast<const char *>(
+              std::memchr(lineBegin, '\n', rangeEnd - lineBegin));
+          if (lineEnd == nullptr)
+            lineEnd = rangeEnd;
+          if (isDataLine(lineBegin, lineEnd))
+            ++numLines;
+          lineBegin = lineEnd + 1;
         }
+        firstLineNumber[i + 1] = numLines;
       }
-      QStringView line_view(line);
-      tmpFields = line_view.split(split_regex, Qt::SkipEmptyParts);
-      // skip blank lines
-      if (tmpFields.size() <= 0)
-        continue;
-      // skip comment lines start with #
-      if (tmpFields[0].startsWith(QChar('#')))
-        continue;
-      for (int i = 0; i < mEnergyTitle.size(); ++i) {
-        if (lineNumber < mLog.size()) {
-          const auto map_iterator = mLog.getEnergyDataIterator(mEnergyTitle[i]);
-          if (map_iterator != mLog.getEnergyDataIteratorEnd()) {
-            const auto item = map_iterator.value()[lineNumber];
-            energyBinning[i](tmpFields, item, read_ok);
-            if (!read_ok) {
-              emit error(
-                  "Failed to read file. Please check the format of the log.");
+    });
+    for (size_t i = 0; i < numRanges; ++i) {
+      firstLineNumber[i + 1] += firstLineNumber[i];
+    }
+    // each worker bins its ranges into its own histograms, which are added
+    // up at the end
+    std::vector<std::vector<HistogramScalar<double>>> partialEnergy(numThreads);
+    std::vector<std::vector<HistogramVector<double>>> partialForce(numThreads);
+    std::vector<HistogramScalar<double>> partialCount(numThreads);
+    std::atomic<qint64> totalReadSize(0);
+    std::atomic<int> previousProgress(0);
+    auto reportProgress = [&](qint64 newReadSize) {
+      const double readSize = totalReadSize += newReadSize;
+      const int readingProgress =
+          fileSize > 0 ? std::nearbyint(readSize / fileSize * 100) : 100;
+      int previous = previousProgress;
+      // only one of the workers reports the same progress
+      if ((readingProgress % refreshPeriod == 0 || readingProgress == 100) &&
+          previous != readingProgress &&
+          previousProgress.compare_exchange_strong(previous, readingProgress)) {
+        qDebug() << Q_FUNC_INFO << "reading " << readingProgress << "%";
+        emit progress("Reading trajectory file", readingProgress);
+      }
+    };
+    nextRange = 0;
+    pool.run([&](size_t threadIndex) {
+      partialEnergy[threadIndex].assign(mEnergyTitle.size(),
+                                        HistogramScalar<double>(mAxes));
+      partialForce[threadIndex].assign(mForceTitle.size(),
+                                       HistogramVector<double>(mAxes, 3));
+      partialCount[threadIndex] = HistogramScalar<double>(mAxes);
+      std::vector<doBinningScalar> energyBinning;
+      std::vector<doBinningVector> forceBinning;
+      for (int j = 0; j < mEnergyTitle.size(); ++j) {
+        energyBinning.push_back(
+            doBinningScalar(partialEnergy[threadIndex][j], mColumns));
+      }
+      for (int j = 0; j < mForceTitle.size(); ++j) {
+        forceBinning.push_back(
+            doBinningVector(partialForce[threadIndex][j], mColumns));
+      }
+      doBinningScalar countBinning(partialCount[threadIndex], mColumns);
+      QList<QStringView> tmpFields;
+      QString line;
+      for (size_t i = nextRange++; i < numRanges; i = nextRange++) {
+        size_t lineNumber = firstLineNumber[i];
+        qint64 readSize = 0;
+        bool read_ok = true;
+        forEachLine(data, boundaries[i], boundaries[i + 1], line,
+                    [&](const QString &fileLine) {
+          readSize += fileLine.size() + 1;
+          if (readSize >= progressBytes) {
+            reportProgress(readSize);
+            readSize = 0;
+          }
+          splitFields(fileLine, tmpFields);
+          // skip blank lines
+          if (tmpFields.size() <= 0)
+            return true;
+          // skip comment lines start with #
+          if (tmpFields[0].startsWith(QChar('#')))
+            return true;
+          for (int j = 0; j < mEnergyTitle.size(); ++j) {
+            if (lineNumber < mLog.size()) {
+              if (energyData[j] != nullptr) {
+                energyBinning[j](tmpFields, (*energyData[j])[lineNumber],
+                                 read_ok);
+                if (!read_ok) {
+                  emit error("Failed to read file. Please check the format "
+                             "of the log.");
+                }
+              }
+            } else {
+              qDebug() << "warning:"
+                       << "trajectory may contain more lines than the log "
+                          "file";
             }
           }
-        } else {
-          qDebug() << "warning:"
-                   << "trajectory may contain more lines than the log file";
-        }
-      }
-      for (int i = 0; i < mForceTitle.size(); ++i) {
-        if (lineNumber < mLog.size()) {
-          const auto map_iterator = mLog.getForceDataIterator(mForceTitle[i]);
-          if (map_iterator != mLog.getForceDataIteratorEnd()) {
-            const auto item = map_iterator.value()[lineNumber];
-            forceBinning[i](tmpFields, item, read_ok);
+          for (int j = 0; j < mForceTitle.size(); ++j) {
+            if (lineNumber < mLog.size()) {
+              if (forceData[j] != nullptr) {
+                forceBinning[j](tmpFields, (*forceData[j])[lineNumber],
+                                read_ok);
+              }
+            } else {
+              qDebug() << "warning:"
+                       << "trajectory may contain more lines than the log "
+                          "file";
+            }
           }
-        } else {
-          qDebug() << "warning:"
-                   << "trajectory may contain more lines than the log file";
-        }
+          countBinning(tmpFields, 1.0, read_ok);
+          ++lineNumber;
+          return true;
+        });
+        reportProgress(readSize);
+      }
+    });
+    for (size_t i = 0; i < numThreads; ++i) {
+      for (int j = 0; j < mEnergyTitle.size(); ++j) {
+        addHistogramData(histEnergy[j].data(), partialEnergy[i][j].data());
+      }
+      for (int j = 0; j < mForceTitle.size(); ++j) {
+        addHistogramData(histForce[j].data(), partialForce[i][j].data());
       }
-      countBinning(tmpFields, 1.0, read_ok);
-      ++lineNumber;
+      addHistogramData(histCount.data(), partialCount[i].data());
     }
     for (int i = 0; i < mEnergyTitle.size(); ++i) {
       for (size_t j = 0; j < histEnergy[i].histogramSize(); ++j) {
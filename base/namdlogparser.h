@@ -134,6 +134,11 @@ private:
   std::vector<Axis> mAxes;
   std::vector<int> mColumns;
   static const int refreshPeriod = 5;
+  // the workers add up the bytes read to the progress every progressBytes
+  static const qint64 progressBytes = 1 << 20;
+  // the file is split into ranges of about rangeBytes, and into at least one
+  // range per worker
+  static const qint64 rangeBytes = 8 << 20;
 };
 
 struct doBinningVector {
@@ -41,6 +41,7 @@ void PMFPathFinderThread::findPath(const PMFPathFinder &x) {
 void PMFPathFinderThread::run() {
   mutex.lock();
   mPMFPathFinder.findPath();
+  mPMFPathFinder.refinePath();
   mutex.unlock();
   emit PathFinderDone(mPMFPathFinder);
 }
@@ -18,51 +18,147 @@
 */
 
 #include "base/reweighting.h"
+#include "base/helper.h"
+#include "base/threadpool.h"
 
-void doReweighting::operator()(const std::vector<double> &fields) {
+#include <QFileInfo>
+#include <algorithm>
+#include <atomic>
+#include <memory>
+
+ReweightingPositions::ReweightingPositions(
+    const std::vector<int> &from_index,
+    const std::vector<std::vector<int>> &to_index)
+    : posOrigin(from_index.size(), 0), posTarget(to_index.size()),
+      targetValueIndex(to_index.size()) {
+  auto valueIndex = [this](int column) {
+    const auto it = std::find(columns.begin(), columns.end(), column);
+    if (it != columns.end())
+      return size_t(it - columns.begin());
+    columns.push_back(column);
+    return columns.size() - 1;
+  };
+  for (const int column : from_index) {
+    originValueIndex.push_back(valueIndex(column));
+  }
+  for (size_t i = 0; i < to_index.size(); ++i) {
+    for (const int column : to_index[i]) {
+      targetValueIndex[i].push_back(valueIndex(column));
+    }
+    posTarget[i].assign(to_index[i].size(), 0);
+  }
+  values.assign(columns.size(), 0);
+}
+
+bool ReweightingPositions::read(const QList<QStringView> &fields) {
+  bool read_ok = true;
+  for (size_t i = 0; i < columns.size(); ++i) {
+    values[i] = fields[columns[i]].toDouble(&read_ok);
+    if (read_ok == false)
+      return false;
+  }
+  scatterValues();
+  return true;
+}
+
+void ReweightingPositions::read(const std::vector<double> &fields) {
+  for (size_t i = 0; i < columns.size(); ++i) {
+    values[i] = fields[columns[i]];
+  }
+  scatterValues();
+}
+
+void ReweightingPositions::scatterValues() {
   for (size_t i = 0; i < posOrigin.size(); ++i) {
-    posOrigin[i] = fields[originPositionIndex[i]];
+    posOrigin[i] = values[originValueIndex[i]];
   }
-  for (size_t j = 0; j < posTarget.size(); ++j) {
-    posTarget[j] = fields[targetPositionIndex[j]];
+  for (size_t i = 0; i < posTarget.size(); ++i) {
+    for (size_t j = 0; j < posTarget[i].size(); ++j) {
+      posTarget[i][j] = values[targetValueIndex[i][j]];
+    }
   }
+}
+
+void doReweighting::operator()(const std::vector<double> &fields) {
+  positions.read(fields);
+  addFrame();
+}
+
+void doReweighting::operator()(const QList<QStringView> &fields,
+                               bool &read_ok) {
+  read_ok = positions.read(fields);
+  if (read_ok == false)
+    return;
+  addFrame();
+}
+
+void doReweighting::addFrame() {
   bool in_origin_grid = true;
-  bool in_target_grid = true;
   const size_t addr_origin =
-      originHistogram.address(posOrigin, &in_origin_grid);
-  const size_t addr_target =
-      targetHistogram.address(posTarget, &in_target_grid);
-  if (in_origin_grid && in_target_grid) {
-    const double weight = -1.0 * originHistogram[addr_origin] / mKbT;
-    targetHistogram[addr_target] += 1.0 * std::exp(weight);
+      originHistogram.address(positions.posOrigin, &in_origin_grid);
+  if (!in_origin_grid)
+    return;
+  const double weight = originWeight[addr_origin];
+  for (size_t i = 0; i < targetHistograms.size(); ++i) {
+    bool in_target_grid = true;
+    const size_t addr_target =
+        targetHistograms[i].address(positions.posTarget[i], &in_target_grid);
+    if (in_target_grid) {
+      targetHistograms[i][addr_target] += weight;
+    }
   }
 }
 
-void doReweighting::operator()(const QList<QStringView> &fields,
-                               bool &read_ok) {
-  for (size_t i = 0; i < posOrigin.size(); ++i) {
-    posOrigin[i] = fields[originPositionIndex[i]].toDouble(&read_ok);
-    if (read_ok == false)
-      return;
+std::vector<double>
+doReweighting::computeWeights(const HistogramScalar<double> &from, double kbT,
+                              bool shiftByMinimum, ThreadPool &pool) {
+  qDebug() << "Calling" << Q_FUNC_INFO;
+  const std::vector<double> &data = from.data();
+  double shift = 0;
+  if (shiftByMinimum && !data.empty()) {
+    shift = *std::min_element(data.begin(), data.end());
   }
-  for (size_t j = 0; j < posTarget.size(); ++j) {
-    posTarget[j] = fields[targetPositionIndex[j]].toDouble(&read_ok);
-    if (read_ok == false)
-      return;
+  const double factor = -1.0 / kbT;
+  std::vector<double> weights(data.size());
+  pool.parallelFor(data.size(), [&](size_t begin, size_t end, size_t) {
+    for (size_t i = begin; i < end; ++i) {
+      weights[i] = std::exp((data[i] - shift) * factor);
+    }
+  });
+  return weights;
+}
+
+void doMetadynamicsReweighting::operator()(const QList<QStringView> &fields,
+                                           bool &read_ok) {
+  const qint64 step = fields[stepColumnIndex].toLongLong(&read_ok);
+  if (read_ok == false || step < metadynamicsBias.step()) {
+    read_ok = false;
+    return;
   }
+  read_ok = positions.read(fields);
+  if (read_ok == false)
+    return;
+  metadynamicsBias.advanceTo(step);
   bool in_origin_grid = true;
-  bool in_target_grid = true;
-  const size_t addr_origin =
-      originHistogram.address(posOrigin, &in_origin_grid);
-  const size_t addr_target =
-      targetHistogram.address(posTarget, &in_target_grid);
-  if (in_origin_grid && in_target_grid) {
-    const double weight = -1.0 * originHistogram[addr_origin] / mKbT;
-    targetHistogram[addr_target] += 1.0 * std::exp(weight);
+  const double bias = metadynamicsBias.bias(positions.posOrigin,
+                                            &in_origin_grid);
+  if (!in_origin_grid)
+    return;
+  const double weight =
+      std::exp((bias - metadynamicsBias.offset(mKbT)) / mKbT);
+  for (size_t i = 0; i < targetHistograms.size(); ++i) {
+    bool in_target_grid = true;
+    const size_t addr_target =
+        targetHistograms[i].address(positions.posTarget[i], &in_target_grid);
+    if (in_target_grid) {
+      targetHistograms[i][addr_target] += weight;
+    }
   }
 }
 
-ReweightingThread::ReweightingThread(QObject *parent) : QThread(parent) {}
+ReweightingThread::ReweightingThread(QObject *parent)
+    : QThread(parent), mNumThreads(0), mShiftWeights(false), mStepColumn(0),
+      mWellTempered(false), mBiasTemperature(0.0), mTemperature(1.0) {}
 
 void ReweightingThread::reweighting(const QStringList &trajectoryFileName,
                                     const QString &outputFileName,
@@ -72,13 +168,21 @@ void ReweightingThread::reweighting(const QStringList &trajectoryFileName,
                                     const std::vector<Axis> &targetAxis,
                                     double kbT, bool usePMF) {
   qDebug() << Q_FUNC_INFO;
+  reweighting(trajectoryFileName, source, from,
+              {ReweightingTarget{to, targetAxis, outputFileName}}, kbT,
+              usePMF);
+}
+
+void ReweightingThread::reweighting(
+    const QStringList &trajectoryFileName,
+    const HistogramScalar<double> &source, const std::vector<int> &from,
+    const std::vector<ReweightingTarget> &targets, double kbT, bool usePMF) {
+  qDebug() << Q_FUNC_INFO;
   QMutexLocker locker(&mutex);
   mTrajectoryFileName = trajectoryFileName;
-  mOutputFileName = outputFileName;
   mSourceHistogram = source;
   mFromColumn = from;
-  mToColumn = to;
-  mTargetAxis = targetAxis;
+  mTargets = targets;
   mKbT = kbT;
   mUsePMF = usePMF;
   if (!isRunning()) {
@@ -86,6 +190,29 @@ void ReweightingThread::reweighting(const QStringList &trajectoryFileName,
   }
 }
 
+void ReweightingThread::setNumThreads(size_t numThreads) {
+  QMutexLocker locker(&mutex);
+  mNumThreads = numThreads;
+}
+
+void ReweightingThread::setShiftWeights(bool shiftWeights) {
+  QMutexLocker locker(&mutex);
+  mShiftWeights = shiftWeights;
+}
+
+void ReweightingThread::setMetadynamicsBias(
+    const QString &hillsTrajectoryFileName, const std::vector<Axis> &biasAxis,
+    int stepColumn, bool wellTempered, double biasTemperature,
+    double temperature) {
+  QMutexLocker locker(&mutex);
+  mHillsTrajectoryFileName = hillsTrajectoryFileName;
+  mBiasAxis = biasAxis;
+  mStepColumn = stepColumn;
+  mWellTempered = wellTempered;
+  mBiasTemperature = biasTemperature;
+  mTemperature = temperature;
+}
+
 ReweightingThread::~ReweightingThread() {
   // am I doing the right things?
   qDebug() << Q_FUNC_INFO;
@@ -98,62 +225,231 @@ ReweightingThread::~ReweightingThread() {
 void ReweightingThread::run() {
   qDebug() << Q_FUNC_INFO;
   qDebug() << Q_FUNC_INFO << ": from columns " << mFromColumn;
-  qDebug() << Q_FUNC_INFO << ": to columns " << mToColumn;
   qDebug() << Q_FUNC_INFO << ": using kbt = " << mKbT;
-  qDebug() << Q_FUNC_INFO << ": target axis " << mTargetAxis;
   mutex.lock();
-  HistogramProbability result(mTargetAxis);
-  doReweighting reweightingObject(mSourceHistogram, result, mFromColumn,
-                                  mToColumn, mKbT);
-  int numFile = 0;
-  const QRegularExpression split_regex("[(),\\s]+");
-  for (auto it = mTrajectoryFileName.begin(); it != mTrajectoryFileName.end();
-       ++it) {
-    qDebug() << "Reading file " << (*it);
-    QFile trajectoryFile(*it);
-    if (trajectoryFile.open(QFile::ReadOnly)) {
-      const double fileSize = trajectoryFile.size();
-      QTextStream ifs(&trajectoryFile);
+  // each frame is read once and added to the histograms of all targets
+  std::vector<std::vector<int>> toColumns;
+  auto targetHistograms = [this]() {
+    std::vector<HistogramProbability> histograms;
+    for (const auto &target : mTargets) {
+      histograms.push_back(HistogramProbability(target.axes));
+    }
+    return histograms;
+  };
+  for (const auto &target : mTargets) {
+    qDebug() << Q_FUNC_INFO << ": to columns " << target.columns;
+    qDebug() << Q_FUNC_INFO << ": target axis " << target.axes;
+    toColumns.push_back(target.columns);
+  }
+  std::vector<HistogramProbability> results = targetHistograms();
+  const size_t numFiles = mTrajectoryFileName.size();
+  // the progress is the fraction of bytes read from all files
+  double totalSize = 0;
+  for (const auto &filename : mTrajectoryFileName) {
+    totalSize += QFileInfo(filename).size();
+  }
+  std::atomic<qint64> totalReadSize(0);
+  std::atomic<int> numFilesRead(0);
+  std::atomic<qint64> previousProgress(0);
+  auto reportProgress = [&](qint64 newReadSize) {
+    const qint64 readSize = totalReadSize += newReadSize;
+    const qint64 readingProgress =
+        totalSize > 0 ? std::nearbyint(readSize / totalSize * 100) : 100;
+    qint64 previous = previousProgress;
+    // only one of the workers reports the same progress
+    if ((readingProgress - previous >= refreshPeriod ||
+         (readingProgress == 100 && previous != 100)) &&
+        previousProgress.compare_exchange_strong(previous, readingProgress)) {
+      qDebug() << Q_FUNC_INFO << "reading " << readingProgress << "%";
+      emit progress(std::min(numFilesRead.load(), int(numFiles) - 1),
+                    readingProgress);
+    }
+  };
+  // the buffers of the lines and the fields are reused by all lines of the
+  // files read by a worker, and a line that cannot be read either stops the
+  // file or is skipped with the error reported once if skipErrors
+  auto reweightFile = [&](const QString &filename, QString &line,
+                          QList<QStringView> &tmpFields,
+                          auto &reweightingObject,
+                          const QString &readErrorMessage, bool skipErrors) {
+    qDebug() << "Reading file " << filename;
+    QFile trajectoryFile(filename);
+    if (!trajectoryFile.open(QFile::ReadOnly)) {
+      emit error("Failed to open file " + filename);
+      return false;
+    }
+    QTextStream ifs(&trajectoryFile);
+    qint64 readSize = 0;
+    bool read_ok = true;
+    bool read_failed = false;
+    while (!ifs.atEnd()) {
+      ifs.readLineInto(&line);
+      readSize += line.size() + 1;
+      if (readSize >= progressBytes) {
+        reportProgress(readSize);
+        readSize = 0;
+      }
+      splitFields(line, tmpFields);
+      // skip blank lines
+      if (tmpFields.size() <= 0)
+        continue;
+      // skip comment lines start with #
+      if (tmpFields[0].startsWith(QChar('#')))
+        continue;
+      reweightingObject(tmpFields, read_ok);
+      if (read_ok == false) {
+        if (!read_failed) {
+          emit error(readErrorMessage);
+        }
+        read_failed = true;
+        if (!skipErrors)
+          break;
+        read_ok = true;
+      }
+    }
+    ++numFilesRead;
+    reportProgress(readSize);
+    return read_ok;
+  };
+  if (!mHillsTrajectoryFileName.isEmpty()) {
+    // the time-dependent bias requires the frames in the order of the steps
+    qDebug() << Q_FUNC_INFO << ": using hills from" << mHillsTrajectoryFileName;
+    MetadynamicsBias metadynamicsBias(mBiasAxis, mNumThreads);
+    if (!metadynamicsBias.open(mHillsTrajectoryFileName)) {
+      emit error("Failed to open file " + mHillsTrajectoryFileName);
+      mutex.unlock();
+      return;
+    }
+    metadynamicsBias.setWellTempered(mWellTempered, mBiasTemperature,
+                                     mTemperature);
+    doMetadynamicsReweighting reweightingObject(
+        metadynamicsBias, results, mStepColumn, mFromColumn, toColumns, mKbT);
+    QString line;
+    QList<QStringView> tmpFields;
+    for (const auto &filename : mTrajectoryFileName) {
+      if (!reweightFile(filename, line, tmpFields, reweightingObject,
+                        "Failed to convert to number, or the steps are not "
+                        "in order!",
+                        false)) {
+        break;
+      }
+    }
+  } else if (numFiles > 0) {
+    // the files are mapped into memory and split into ranges of whole lines,
+    // and the files that cannot be mapped are read as a single range
+    struct LineRange {
+      size_t mFileIndex;
+      qint64 mBegin;
+      qint64 mEnd;
+    };
+    std::vector<std::unique_ptr<QFile>> trajectoryFiles(numFiles);
+    std::vector<const char *> mappedData(numFiles, nullptr);
+    std::vector<LineRange> ranges;
+    std::vector<std::atomic<size_t>> remainingRanges(numFiles);
+    // a line that cannot be read is skipped, so that the result does not
+    // depend on the order in which the workers read the ranges, and the
+    // error is reported once per file
+    std::vector<std::atomic<bool>> readFailed(numFiles);
+    for (size_t i = 0; i < numFiles; ++i) {
+      trajectoryFiles[i] = std::make_unique<QFile>(mTrajectoryFileName[i]);
+      QFile &trajectoryFile = *trajectoryFiles[i];
+      if (!trajectoryFile.open(QFile::ReadOnly)) {
+        ranges.push_back({i, 0, 0});
+        continue;
+      }
+      const qint64 fileSize = trajectoryFile.size();
+      if (fileSize > 0) {
+        mappedData[i] = reinterpret_cast<const char *>(
+            trajectoryFile.map(0, fileSize));
+      }
+      if (mappedData[i] == nullptr) {
+        trajectoryFile.close();
+        ranges.push_back({i, 0, 0});
+        continue;
+      }
+      const std::vector<qint64> boundaries = splitLineRanges(
+          mappedData[i], fileSize, (fileSize + rangeBytes - 1) / rangeBytes);
+      for (size_t j = 0; j + 1 < boundaries.size(); ++j) {
+        ranges.push_back({i, boundaries[j], boundaries[j + 1]});
+      }
+      remainingRanges[i] = boundaries.size() - 1;
+    }
+    // the workers take the ranges one by one, and each of them sums the
+    // weights into its own histogram, which are added up at the end
+    const size_t numThreads =
+        mNumThreads > 0 ? mNumThreads : ThreadPool::defaultNumThreads();
+    ThreadPool pool(std::min(numThreads, ranges.size()));
+    // the weights depend only on the bins of the source histogram
+    const std::vector<double> sourceWeights = doReweighting::computeWeights(
+        mSourceHistogram, mKbT, mShiftWeights || mUsePMF, pool);
+    std::vector<std::vector<HistogramProbability>> partialResults(
+        pool.numThreads());
+    std::atomic<size_t> nextRange(0);
+    const QString skipErrorMessage =
+        "Failed to convert to number! The lines are skipped.";
+    pool.run([&](size_t threadIndex) {
+      std::vector<HistogramProbability> &partialResult =
+          partialResults[threadIndex];
+      partialResult = targetHistograms();
+      doReweighting reweightingObject(mSourceHistogram, sourceWeights,
+                                      partialResult, mFromColumn, toColumns);
       QString line;
       QList<QStringView> tmpFields;
-      double readSize = 0;
-      qint64 previousProgress = 0;
-      bool read_ok = true;
-      while (!ifs.atEnd()) {
-        ifs.readLineInto(&line);
-        readSize += line.size() + 1;
-        const int readingProgress = std::nearbyint(readSize / fileSize * 100);
-        if (readingProgress % refreshPeriod == 0 || readingProgress == 100) {
-          if (previousProgress != readingProgress) {
-            previousProgress = readingProgress;
-            qDebug() << Q_FUNC_INFO << "reading " << readingProgress << "%";
-            emit progress(numFile, readingProgress);
-          }
-        }
-        QStringView line_view(line);
-        tmpFields = line_view.split(split_regex, Qt::SkipEmptyParts);
-        // skip blank lines
-        if (tmpFields.size() <= 0)
-          continue;
-        // skip comment lines start with #
-        if (tmpFields[0].startsWith(QChar('#')))
+      for (size_t i = nextRange++; i < ranges.size(); i = nextRange++) {
+        const LineRange &range = ranges[i];
+        const char *data = mappedData[range.mFileIndex];
+        if (data == nullptr) {
+          reweightFile(mTrajectoryFileName[range.mFileIndex], line, tmpFields,
+                       reweightingObject, skipErrorMessage, true);
           continue;
-        reweightingObject(tmpFields, read_ok);
-        if (read_ok == false) {
-          emit error("Failed to convert to number!");
-          break;
+        }
+        qint64 readSize = 0;
+        bool read_failed = false;
+        forEachLine(data, range.mBegin, range.mEnd, line,
+                    [&](const QString &fileLine) {
+                      readSize += fileLine.size() + 1;
+                      if (readSize >= progressBytes) {
+                        reportProgress(readSize);
+                        readSize = 0;
+                      }
+                      splitFields(fileLine, tmpFields);
+                      // skip blank lines and comment lines start with #
+                      if (tmpFields.size() <= 0 ||
+                          tmpFields[0].startsWith(QChar('#')))
+                        return true;
+                      bool read_ok = true;
+                      reweightingObject(tmpFields, read_ok);
+                      if (read_ok == false)
+                        read_failed = true;
+                      return true;
+                    });
+        if (read_failed && !readFailed[range.mFileIndex].exchange(true)) {
+          emit error(skipErrorMessage);
+        }
+        if (--remainingRanges[range.mFileIndex] == 0)
+          ++numFilesRead;
+        reportProgress(readSize);
+      }
+    });
+    for (const auto &partialResult : partialResults) {
+      for (size_t i = 0; i < results.size(); ++i) {
+        std::vector<double> &resultData = results[i].data();
+        const std::vector<double> &partialData = partialResult[i].data();
+        for (size_t j = 0; j < resultData.size(); ++j) {
+          resultData[j] += partialData[j];
         }
       }
-      ++numFile;
-    } else {
-      emit error("Failed to open file " + (*it));
     }
   }
-  if (mUsePMF) {
-    result.convertToFreeEnergy(mKbT);
+  for (size_t i = 0; i < results.size(); ++i) {
+    if (mUsePMF) {
+      results[i].convertToFreeEnergy(mKbT);
+    }
+    results[i].writeToFile(mTargets[i].outputFileName);
   }
-  result.writeToFile(mOutputFileName);
   emit done();
-  emit doneReturnTarget(result);
+  if (!results.empty()) {
+    emit doneReturnTarget(results.front());
+  }
   mutex.unlock();
 }
@@ -21,29 +21,86 @@
 #define REWEIGHTINGTHREAD_H
 
 #include "base/histogram.h"
+#include "base/metadynamics.h"
 
 #include <QObject>
 #include <QThread>
 #include <QMutex>
 
+class ThreadPool;
+
+// a histogram of the reweighted target columns, and the file to write it
+struct ReweightingTarget {
+  std::vector<int> columns;
+  std::vector<Axis> axes;
+  QString outputFileName;
+};
+
+// the positions of a frame in the origin and all target histograms, where
+// a column shared by several histograms is converted to number only once
+struct ReweightingPositions {
+  ReweightingPositions(const std::vector<int> &from_index,
+                       const std::vector<std::vector<int>> &to_index);
+  // return false if a field is not a number
+  bool read(const QList<QStringView> &fields);
+  void read(const std::vector<double> &fields);
+  std::vector<double> posOrigin;
+  std::vector<std::vector<double>> posTarget;
+
+private:
+  void scatterValues();
+  std::vector<int> columns;
+  std::vector<double> values;
+  std::vector<size_t> originValueIndex;
+  std::vector<std::vector<size_t>> targetValueIndex;
+};
+
 struct doReweighting {
-  doReweighting(const HistogramScalar<double> &from, HistogramProbability &to,
+  // from_weight is the weight of each bin of from, see computeWeights(), and
+  // the weight of a frame is added to all target histograms
+  doReweighting(const HistogramScalar<double> &from,
+                const std::vector<double> &from_weight,
+                std::vector<HistogramProbability> &to,
                 const std::vector<int> &from_index,
-                const std::vector<int> &to_index, double kbT)
-      : originHistogram(from), targetHistogram(to),
-        originPositionIndex(from_index), targetPositionIndex(to_index),
-        mKbT(kbT), posOrigin(originHistogram.dimension(), 0),
-        posTarget(targetHistogram.dimension(), 0) {}
+                const std::vector<std::vector<int>> &to_index)
+      : originHistogram(from), originWeight(from_weight), targetHistograms(to),
+        positions(from_index, to_index) {}
   void operator()(const std::vector<double> &fields);
   void operator()(const QList<QStringView> &fields, bool& read_ok);
+  // the weights exp(-F / kbT) of all bins of the PMF from, which are scaled
+  // by exp(Fmin / kbT) to avoid overflow and underflow if shiftByMinimum
+  static std::vector<double> computeWeights(const HistogramScalar<double> &from,
+                                            double kbT, bool shiftByMinimum,
+                                            ThreadPool &pool);
   const HistogramScalar<double> &originHistogram;
-  HistogramProbability &targetHistogram;
-  std::vector<int> originPositionIndex;
-  std::vector<int> targetPositionIndex;
+  const std::vector<double> &originWeight;
+  std::vector<HistogramProbability> &targetHistograms;
+  // temporary variables
+  ReweightingPositions positions;
+
+private:
+  void addFrame();
+};
+
+// reweight each frame by exp((V(s,t) - c(t)) / kbT) with the time-dependent
+// bias of a metadynamics run, where t is the step in stepColumn
+struct doMetadynamicsReweighting {
+  doMetadynamicsReweighting(MetadynamicsBias &bias,
+                            std::vector<HistogramProbability> &to,
+                            int stepColumn, const std::vector<int> &from_index,
+                            const std::vector<std::vector<int>> &to_index,
+                            double kbT)
+      : metadynamicsBias(bias), targetHistograms(to),
+        stepColumnIndex(stepColumn), mKbT(kbT), positions(from_index, to_index) {
+  }
+  // read_ok is false if a field is not a number or the step goes backwards
+  void operator()(const QList<QStringView> &fields, bool& read_ok);
+  MetadynamicsBias &metadynamicsBias;
+  std::vector<HistogramProbability> &targetHistograms;
+  int stepColumnIndex;
   double mKbT;
   // temporary variables
-  std::vector<double> posOrigin;
-  std::vector<double> posTarget;
+  ReweightingPositions positions;
 };
 
 class ReweightingThread : public QThread {
@@ -53,6 +110,29 @@ public:
   void reweighting(const QStringList& trajectoryFileName, const QString& outputFileName,
                    const HistogramScalar<double>& source, const std::vector<int>& from,
                    const std::vector<int>& to, const std::vector<Axis>& targetAxis, double kbT, bool usePMF);
+  // reweight to all targets in a single pass over the trajectories, and
+  // doneReturnTarget() returns the histogram of the first target; a line
+  // that cannot be read is skipped and reported once per file, except with
+  // the metadynamics bias, where the file stops at that line
+  void reweighting(const QStringList& trajectoryFileName,
+                   const HistogramScalar<double>& source,
+                   const std::vector<int>& from,
+                   const std::vector<ReweightingTarget>& targets, double kbT,
+                   bool usePMF);
+  // the trajectories are read in parallel by numThreads threads, where
+  // numThreads == 0 uses ThreadPool::defaultNumThreads()
+  void setNumThreads(size_t numThreads);
+  // scale the probabilities by exp(Fmin / kbT) to avoid overflow and
+  // underflow, which is always done if the result is converted to PMF
+  void setShiftWeights(bool shiftWeights);
+  // reweight by the time-dependent bias summed from the hills trajectory on
+  // biasAxis instead of the source histogram, which requires the frames of
+  // the trajectories in the order of the steps, and an empty filename
+  // switches back to the source histogram
+  void setMetadynamicsBias(const QString& hillsTrajectoryFileName,
+                           const std::vector<Axis>& biasAxis, int stepColumn,
+                           bool wellTempered, double biasTemperature,
+                           double temperature);
   ~ReweightingThread();
 signals:
   void error(QString err);
@@ -65,14 +145,25 @@ private:
   // do we need a lock here?
   QMutex mutex;
   QStringList mTrajectoryFileName;
-  QString mOutputFileName;
   HistogramScalar<double> mSourceHistogram;
   std::vector<int> mFromColumn;
-  std::vector<int> mToColumn;
-  std::vector<Axis> mTargetAxis;
+  std::vector<ReweightingTarget> mTargets;
   double mKbT;
   bool mUsePMF;
+  size_t mNumThreads;
+  bool mShiftWeights;
+  QString mHillsTrajectoryFileName;
+  std::vector<Axis> mBiasAxis;
+  int mStepColumn;
+  bool mWellTempered;
+  double mBiasTemperature;
+  double mTemperature;
   static const int refreshPeriod = 5;
+  // the workers add up the bytes read to the progress every progressBytes
+  static const qint64 progressBytes = 1 << 20;
+  // the mapped files are split into ranges of about rangeBytes, so that the
+  // workers can share a large file
+  static const qint64 rangeBytes = 8 << 20;
 };
 
 #endif // REWEIGHTINGTHREAD_H
@@ -0,0 +1,247 @@
+/*
+  PMFToolBox: A toolbox to analyze and post-process the output of
+  potential of mean force calculations.
+  Copyright (C) 2020  Haochuan Chen
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU Affero General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU Affero General Public License for more details.
+
+  You should have received a copy of the GNU Affero General Public License
+  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "stringmethod.h"
+#include "threadpool.h"
+
+#include <QDebug>
+#include <QElapsedTimer>
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <limits>
+
+StringMethod::StringMethod(const HistogramScalar<double> &pmf)
+    : mPMF(pmf), mAccu(pmf.dimension(), 1),
+      mMinWidth(std::numeric_limits<double>::max()) {
+  const auto &axes = mPMF.axes();
+  for (size_t k = 0; k < mPMF.dimension(); ++k) {
+    if (k > 0)
+      mAccu[k] = mAccu[k - 1] * axes[k - 1].bin();
+    mMinWidth = std::min(mMinWidth, axes[k].width());
+  }
+}
+
+double StringMethod::interpolate(const std::vector<double> &pos,
+                                 std::vector<double> *gradient) const {
+  const size_t dim = mPMF.dimension();
+  const auto &axes = mPMF.axes();
+  // the four bin centers around pos along each axis, and their Catmull-Rom
+  // weights and the derivatives of the weights
+  std::vector<std::array<size_t, 4>> index(dim);
+  std::vector<std::array<double, 4>> weight(dim);
+  std::vector<std::array<double, 4>> dweight(dim);
+  for (size_t k = 0; k < dim; ++k) {
+    const long bins = static_cast<long>(axes[k].bin());
+    const double u = (axes[k].wrap(pos[k]) - axes[k].lowerBound()) /
+                         axes[k].width() -
+                     0.5;
+    long i = static_cast<long>(std::floor(u));
+    if (!axes[k].realPeriodic()) {
+      // extrapolate near the boundaries, and repeat the boundary bins
+      i = std::clamp(i, 0L, std::max(bins - 2, 0L));
+    }
+    const double t = u - i;
+    const double t2 = t * t;
+    const double t3 = t2 * t;
+    weight[k] = {0.5 * (-t3 + 2.0 * t2 - t), 0.5 * (3.0 * t3 - 5.0 * t2 + 2.0),
+                 0.5 * (-3.0 * t3 + 4.0 * t2 + t), 0.5 * (t3 - t2)};
+    dweight[k] = {0.5 * (-3.0 * t2 + 4.0 * t - 1.0), 0.5 * (9.0 * t2 - 10.0 * t),
+                  0.5 * (-9.0 * t2 + 8.0 * t + 1.0), 0.5 * (3.0 * t2 - 2.0 * t)};
+    for (long j = 0; j < 4; ++j) {
+      const long n = i - 1 + j;
+      index[k][j] = axes[k].realPeriodic() ? ((n % bins) + bins) % bins
+                                           : std::clamp(n, 0L, bins - 1);
+    }
+  }
+  double value = 0;
+  if (gradient != nullptr)
+    gradient->assign(dim, 0.0);
+  // iterate over the 4^dim stencil points
+  std::vector<size_t> corner(dim, 0);
+  while (true) {
+    size_t addr = 0;
+    double w = 1.0;
+    for (size_t k = 0; k < dim; ++k) {
+      addr += index[k][corner[k]] * mAccu[k];
+      w *= weight[k][corner[k]];
+    }
+    const double v = mPMF[addr];
+    value += w * v;
+    if (gradient != nullptr) {
+      for (size_t k = 0; k < dim; ++k) {
+        double partial = v * dweight[k][corner[k]];
+        for (size_t j = 0; j < dim; ++j) {
+          if (j != k)
+            partial *= weight[j][corner[j]];
+        }
+        (*gradient)[k] += partial / axes[k].width();
+      }
+    }
+    size_t k = 0;
+    for (; k < dim; ++k) {
+      if (++corner[k] < 4)
+        break;
+      corner[k] = 0;
+    }
+    if (k == dim)
+      break;
+  }
+  return value;
+}
+
+void StringMethod::confine(std::vector<double> &pos) const {
+  const auto &axes = mPMF.axes();
+  for (size_t k = 0; k < pos.size(); ++k) {
+    pos[k] = axes[k].wrap(pos[k]);
+    if (!axes[k].realPeriodic()) {
+      pos[k] =
+          std::clamp(pos[k], axes[k].lowerBound(), axes[k].upperBound());
+    }
+  }
+}
+
+std::vector<std::vector<double>>
+StringMethod::reparametrize(const std::vector<std::vector<double>> &path,
+                            size_t numImages) const {
+  if (path.size() < 2 || numImages < 2)
+    return path;
+  const size_t dim = mPMF.dimension();
+  const auto &axes = mPMF.axes();
+  // the displacements between successive points, crossing the periodic
+  // boundaries if that is shorter
+  std::vector<std::vector<double>> segments(path.size(),
+                                            std::vector<double>(dim, 0.0));
+  std::vector<double> arc_length(path.size(), 0.0);
+  for (size_t i = 1; i < path.size(); ++i) {
+    double length = 0;
+    for (size_t k = 0; k < dim; ++k) {
+      segments[i][k] = axes[k].dist(path[i][k], path[i - 1][k]);
+      length += segments[i][k] * segments[i][k];
+    }
+    arc_length[i] = arc_length[i - 1] + std::sqrt(length);
+  }
+  const double total_length = arc_length.back();
+  std::vector<std::vector<double>> images(numImages);
+  images.front() = path.front();
+  images.back() = path.back();
+  size_t j = 1;
+  for (size_t m = 1; m + 1 < numImages; ++m) {
+    const double target = total_length * m / (numImages - 1);
+    while (j + 1 < path.size() && arc_length[j] < target)
+      ++j;
+    const double segment_length = arc_length[j] - arc_length[j - 1];
+    const double f =
+        segment_length > 0 ? (target - arc_length[j - 1]) / segment_length
+                           : 0.0;
+    images[m] = path[j - 1];
+    for (size_t k = 0; k < dim; ++k) {
+      images[m][k] += f * segments[j][k];
+    }
+    confine(images[m]);
+  }
+  return images;
+}
+
+StringMethod::Result
+StringMethod::optimize(const std::vector<std::vector<double>> &initialPath,
+                       size_t numImages, double stepSize,
+                       size_t maxIterations, double tolerance,
+                       size_t numThreads) const {
+  qDebug() << "Calling" << Q_FUNC_INFO;
+  QElapsedTimer timer;
+  timer.start();
+  Result result;
+  result.mNumIterations = 0;
+  result.mConverged = false;
+  if (initialPath.size() < 2) {
+    qWarning() << "The string needs at least two images.";
+    return result;
+  }
+  const size_t dim = mPMF.dimension();
+  const auto &axes = mPMF.axes();
+  const size_t num_images = numImages >= 2 ? numImages : initialPath.size();
+  auto &images = result.mImages;
+  auto &energies = result.mEnergies;
+  images = reparametrize(initialPath, num_images);
+  energies.assign(num_images, 0.0);
+  std::vector<std::vector<double>> gradients(num_images);
+  ThreadPool pool(numThreads > 0 ? numThreads
+                                 : ThreadPool::defaultNumThreads());
+  // the images are independent of each other, so evaluate them in chunks
+  auto evaluate = [&]() {
+    pool.parallelFor(num_images, [&](size_t begin, size_t end, size_t) {
+      for (size_t i = begin; i < end; ++i) {
+        energies[i] = interpolate(images[i], &gradients[i]);
+      }
+    });
+  };
+  evaluate();
+  // limit the displacement of an image in one iteration to half of a bin
+  const double max_step = 0.5 * mMinWidth;
+  double dt = stepSize;
+  if (dt <= 0) {
+    double max_gradient = 0;
+    for (size_t i = 1; i + 1 < num_images; ++i) {
+      double norm = 0;
+      for (size_t k = 0; k < dim; ++k)
+        norm += gradients[i][k] * gradients[i][k];
+      max_gradient = std::max(max_gradient, std::sqrt(norm));
+    }
+    dt = max_gradient > 0 ? 0.1 * mMinWidth / max_gradient : 0.0;
+  }
+  qDebug() << "String method: number of images:" << num_images
+           << "; step size:" << dt;
+  std::vector<double> step(dim);
+  while (result.mNumIterations < maxIterations) {
+    const auto previous = images;
+    for (size_t i = 1; i + 1 < num_images; ++i) {
+      double norm = 0;
+      for (size_t k = 0; k < dim; ++k) {
+        step[k] = -dt * gradients[i][k];
+        norm += step[k] * step[k];
+      }
+      norm = std::sqrt(norm);
+      const double scale = norm > max_step ? max_step / norm : 1.0;
+      for (size_t k = 0; k < dim; ++k)
+        images[i][k] += scale * step[k];
+      confine(images[i]);
+    }
+    images = reparametrize(images, num_images);
+    evaluate();
+    ++result.mNumIterations;
+    double max_displacement = 0;
+    for (size_t i = 1; i + 1 < num_images; ++i) {
+      double displacement = 0;
+      for (size_t k = 0; k < dim; ++k) {
+        const double d = axes[k].dist(images[i][k], previous[i][k]);
+        displacement += d * d;
+      }
+      max_displacement = std::max(max_displacement, std::sqrt(displacement));
+    }
+    if (max_displacement <= tolerance * mMinWidth) {
+      result.mConverged = true;
+      break;
+    }
+  }
+  qDebug() << "String method takes" << timer.elapsed()
+           << "milliseconds; number of iterations:" << result.mNumIterations
+           << "; converged:" << result.mConverged;
+  return result;
+}
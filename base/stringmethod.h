@@ -0,0 +1,67 @@
+/*
+  PMFToolBox: A toolbox to analyze and post-process the output of
+  potential of mean force calculations.
+  Copyright (C) 2020  Haochuan Chen
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU Affero General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU Affero General Public License for more details.
+
+  You should have received a copy of the GNU Affero General Public License
+  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef STRINGMETHOD_H
+#define STRINGMETHOD_H
+
+#include "base/histogram.h"
+
+#include <cstddef>
+#include <vector>
+
+// The zero-temperature string method (simplified version of E, Ren and
+// Vanden-Eijnden) on a PMF interpolated between the bin centers by
+// Catmull-Rom splines, whose gradients are continuous. In each iteration
+// the interior images descend along the interpolated gradient, and then the
+// string is reparametrized so that the images are equally spaced in arc
+// length, which removes the tangential component of the descent. The two
+// end images are fixed. Since the images are not restricted to the bin
+// centers, a coarse grid gives a smooth minimum energy path.
+class StringMethod {
+public:
+  struct Result {
+    std::vector<std::vector<double>> mImages;
+    std::vector<double> mEnergies;
+    size_t mNumIterations;
+    bool mConverged;
+  };
+  explicit StringMethod(const HistogramScalar<double> &pmf);
+  // the interpolated PMF at pos, and its gradient if gradient is not null
+  double interpolate(const std::vector<double> &pos,
+                     std::vector<double> *gradient = nullptr) const;
+  // the images evenly spaced in arc length along the polyline of path
+  std::vector<std::vector<double>>
+  reparametrize(const std::vector<std::vector<double>> &path,
+                size_t numImages) const;
+  // relax the string starting from initialPath; a non-positive stepSize is
+  // chosen automatically, and the string is converged if no image moves
+  // more than tolerance times the smallest bin width in an iteration
+  Result optimize(const std::vector<std::vector<double>> &initialPath,
+                  size_t numImages, double stepSize, size_t maxIterations,
+                  double tolerance, size_t numThreads) const;
+
+private:
+  // keep the position in the periodic range or inside the grid
+  void confine(std::vector<double> &pos) const;
+  const HistogramScalar<double> &mPMF;
+  std::vector<size_t> mAccu;
+  double mMinWidth;
+};
+
+#endif // STRINGMETHOD_H
@@ -0,0 +1,95 @@
+/*
+  PMFToolBox: A toolbox to analyze and post-process the output of
+  potential of mean force calculations.
+  Copyright (C) 2020  Haochuan Chen
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU Affero General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU Affero General Public License for more details.
+
+  You should have received a copy of the GNU Affero General Public License
+  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "threadpool.h"
+
+#include <algorithm>
+
+ThreadPool::ThreadPool(size_t numThreads)
+    : mTask(nullptr), mGeneration(0), mNumPending(0), mShutdown(false) {
+  numThreads = std::max(numThreads, size_t(1));
+  for (size_t i = 0; i < numThreads; ++i) {
+    mThreads.push_back(std::thread(&ThreadPool::workerLoop, this, i));
+  }
+}
+
+ThreadPool::~ThreadPool() {
+  {
+    std::lock_guard<std::mutex> lk(mMutex);
+    mShutdown = true;
+  }
+  mStartCondVar.notify_all();
+  for (size_t i = 0; i < mThreads.size(); ++i) {
+    if (mThreads[i].joinable())
+      mThreads[i].join();
+  }
+}
+
+size_t ThreadPool::numThreads() const { return mThreads.size(); }
+
+void ThreadPool::run(const std::function<void(size_t)> &func) {
+  std::unique_lock<std::mutex> lk(mMutex);
+  mTask = &func;
+  mNumPending = mThreads.size();
+  ++mGeneration;
+  mStartCondVar.notify_all();
+  // wait until the whole batch is done
+  mDoneCondVar.wait(lk, [this]() { return mNumPending == 0; });
+  mTask = nullptr;
+}
+
+void ThreadPool::parallelFor(
+    size_t size, const std::function<void(size_t, size_t, size_t)> &func) {
+  const size_t chunkSize = (size + mThreads.size() - 1) / mThreads.size();
+  run([&](size_t threadIndex) {
+    const size_t begin = std::min(size, threadIndex * chunkSize);
+    const size_t end = std::min(size, begin + chunkSize);
+    func(begin, end, threadIndex);
+  });
+}
+
+size_t ThreadPool::defaultNumThreads() {
+  // keep one core for the GUI and the I/O
+  const size_t numCores = std::thread::hardware_concurrency();
+  return numCores > 1 ? numCores - 1 : 1;
+}
+
+void ThreadPool::workerLoop(size_t threadIndex) {
+  size_t lastGeneration = 0;
+  while (true) {
+    const std::function<void(size_t)> *task = nullptr;
+    {
+      std::unique_lock<std::mutex> lk(mMutex);
+      mStartCondVar.wait(lk, [this, lastGeneration]() {
+        return mShutdown || mGeneration != lastGeneration;
+      });
+      if (mShutdown)
+        return;
+      lastGeneration = mGeneration;
+      task = mTask;
+    }
+    (*task)(threadIndex);
+    {
+      std::lock_guard<std::mutex> lk(mMutex);
+      --mNumPending;
+      if (mNumPending == 0)
+        mDoneCondVar.notify_one();
+    }
+  }
+}
@@ -0,0 +1,60 @@
+/*
+  PMFToolBox: A toolbox to analyze and post-process the output of
+  potential of mean force calculations.
+  Copyright (C) 2020  Haochuan Chen
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU Affero General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU Affero General Public License for more details.
+
+  You should have received a copy of the GNU Affero General Public License
+  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+
+#include <condition_variable>
+#include <cstddef>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// A pool of worker threads that run the same task in batches. The workers
+// are created once and wait for the next batch after finishing one, and
+// the caller of run() blocks until all workers have finished the batch.
+class ThreadPool {
+public:
+  explicit ThreadPool(size_t numThreads = defaultNumThreads());
+  ~ThreadPool();
+  ThreadPool(const ThreadPool &) = delete;
+  ThreadPool &operator=(const ThreadPool &) = delete;
+  size_t numThreads() const;
+  // call func(threadIndex) on each worker and wait for all of them
+  void run(const std::function<void(size_t)> &func);
+  // split [0, size) into contiguous chunks, call func(begin, end, threadIndex)
+  // for each chunk and wait for all of them
+  void parallelFor(size_t size,
+                   const std::function<void(size_t, size_t, size_t)> &func);
+  static size_t defaultNumThreads();
+
+private:
+  void workerLoop(size_t threadIndex);
+  std::vector<std::thread> mThreads;
+  std::mutex mMutex;
+  std::condition_variable mStartCondVar;
+  std::condition_variable mDoneCondVar;
+  const std::function<void(size_t)> *mTask;
+  size_t mGeneration;
+  size_t mNumPending;
+  bool mShutdown;
+};
+
+#endif // THREADPOOL_H
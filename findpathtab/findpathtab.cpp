@@ -26,12 +26,35 @@
 #include <QJsonParseError>
 #include <QJsonDocument>
 #include <QJsonObject>
+#include <limits>
+
+namespace {
+// read a region from a JSON object like
+// {"Boxes": [{"Center": "0 0", "Lengths": "10 10"}], "Bins": ["20 20"]}
+GridDataRegion readRegionFromJSON(const QJsonObject &jsonRegion) {
+  GridDataRegion region;
+  const QJsonArray jsonBoxes = jsonRegion["Boxes"].toArray();
+  for (const auto &a : jsonBoxes) {
+    const auto jsonBox = a.toObject();
+    region.mBoxes.push_back(
+        GridDataPatch{splitStringToNumbers<double>(jsonBox["Center"].toString()),
+                      splitStringToNumbers<double>(jsonBox["Lengths"].toString()),
+                      0});
+  }
+  const QJsonArray jsonBins = jsonRegion["Bins"].toArray();
+  for (const auto &a : jsonBins) {
+    region.mPoints.push_back(splitStringToNumbers<double>(a.toString()));
+  }
+  return region;
+}
+} // namespace
 
 FindPathTab::FindPathTab(QWidget *parent)
     : QWidget(parent), ui(new Ui::FindPathTab),
       mPatchTable(new PatchTableModel(this)) {
   ui->setupUi(this);
   setupAvailableAlgorithms();
+  setupAvailableModes();
   ui->tableViewPatch->setModel(mPatchTable);
   connect(ui->pushButtonOpen, &QPushButton::clicked, this,
           &FindPathTab::loadPMF);
@@ -59,10 +82,30 @@ void FindPathTab::setupAvailableAlgorithms() {
       Graph::FindPathAlgorithm::Dijkstra;
   mAvailableAlgorithms["Shortest path faster algorithm (SPFA)"] =
       Graph::FindPathAlgorithm::SPFA;
+  mAvailableAlgorithms["A* search"] = Graph::FindPathAlgorithm::AStar;
+  mAvailableAlgorithms["Bidirectional Dijkstra's algorithm"] =
+      Graph::FindPathAlgorithm::BidirectionalDijkstra;
+  mAvailableAlgorithms["Parallel delta-stepping"] =
+      Graph::FindPathAlgorithm::DeltaStepping;
+  mAvailableAlgorithms["Lifelong planning A* (incremental)"] =
+      Graph::FindPathAlgorithm::LPAStar;
   for (auto it = mAvailableAlgorithms.cbegin();
        it != mAvailableAlgorithms.cend(); ++it) {
     ui->comboBoxAlgorithm->addItem(it.key());
   }
+  ui->comboBoxAlgorithm->setCurrentText("Dijkstra's algorithm");
+}
+
+void FindPathTab::setupAvailableModes() {
+  qDebug() << "Calling" << Q_FUNC_INFO;
+  mAvailableModes["MFEP"] = Graph::FindPathMode::MFEPMode;
+  mAvailableModes["Sum of energies"] = Graph::FindPathMode::SumOfEdges;
+  mAvailableModes["Maximum energy"] = Graph::FindPathMode::MaximumEdges;
+  for (auto it = mAvailableModes.cbegin(); it != mAvailableModes.cend();
+       ++it) {
+    ui->comboBoxMode->addItem(it.key());
+  }
+  ui->comboBoxMode->setCurrentText("MFEP");
 }
 
 Graph::FindPathAlgorithm FindPathTab::selectedAlgorithm() const {
@@ -71,6 +114,12 @@ Graph::FindPathAlgorithm FindPathTab::selectedAlgorithm() const {
   return mAvailableAlgorithms[selectedText];
 }
 
+Graph::FindPathMode FindPathTab::selectedMode() const {
+  qDebug() << "Calling" << Q_FUNC_INFO;
+  const QString selectedText = ui->comboBoxMode->currentText();
+  return mAvailableModes[selectedText];
+}
+
 void FindPathTab::addPatch(const QString &center, const QVector<double> &length,
                            const double value) {
   qDebug() << "Calling" << Q_FUNC_INFO;
@@ -122,12 +171,16 @@ void FindPathTab::findPath() {
       splitStringToNumbers<double>(ui->lineEditStart->text());
   const std::vector<double> posEnd =
       splitStringToNumbers<double>(ui->lineEditEnd->text());
+  const std::vector<double> startRegionLength =
+      splitStringToNumbers<double>(ui->lineEditStartRegion->text());
+  const std::vector<double> endRegionLength =
+      splitStringToNumbers<double>(ui->lineEditEndRegion->text());
   const Graph::FindPathAlgorithm algorithm = selectedAlgorithm();
   // TODO: allow to use a list of patches
   const auto tmp_patchList = mPatchTable->patchList();
   std::vector<GridDataPatch> patchList(tmp_patchList.begin(),
                                        tmp_patchList.end());
-  const Graph::FindPathMode mode = Graph::FindPathMode::MFEPMode;
+  const Graph::FindPathMode mode = selectedMode();
   // check
   if (mPMF.dimension() == 0) {
     const QString errorMsg{"Invalid PMF input!"};
@@ -148,8 +201,29 @@ void FindPathTab::findPath() {
     const QString errorMsg{"Dimensionality of starting or ending"};
     return;
   }
+  if ((!startRegionLength.empty() &&
+       startRegionLength.size() != mPMF.dimension()) ||
+      (!endRegionLength.empty() &&
+       endRegionLength.size() != mPMF.dimension())) {
+    const QString errorMsg{
+        "Dimensionality of the starting or ending region mismatches the PMF."};
+    qDebug() << errorMsg;
+    QMessageBox errorBox;
+    errorBox.critical(this, "Error", errorMsg);
+    return;
+  }
   mPMFPathFinder =
       PMFPathFinder(mPMF, patchList, posStart, posEnd, mode, algorithm);
+  // the regions are boxes centered at the starting and ending points
+  GridDataRegion startRegion;
+  GridDataRegion endRegion;
+  if (!startRegionLength.empty()) {
+    startRegion.mBoxes.push_back(GridDataPatch{posStart, startRegionLength, 0});
+  }
+  if (!endRegionLength.empty()) {
+    endRegion.mBoxes.push_back(GridDataPatch{posEnd, endRegionLength, 0});
+  }
+  mPMFPathFinder.setRegions(startRegion, endRegion);
   mPMFPathFinderThread.findPath(mPMFPathFinder);
   ui->pushButtonFind->setEnabled(false);
   ui->pushButtonFind->setText(tr("Running"));
@@ -157,13 +231,34 @@ void FindPathTab::findPath() {
 
 void FindPathTab::findPathDone(const PMFPathFinder &result) {
   mPMFPathFinder = result;
+  saveResults();
+  ui->pushButtonFind->setText(tr("Find"));
+  ui->pushButtonFind->setEnabled(true);
+}
+
+void FindPathTab::saveResults() {
   mPMFPathFinder.writePath(ui->lineEditOutput->text() + ".path");
   mPMFPathFinder.writeVisitedRegion(ui->lineEditOutput->text() + ".region");
   if (!mPMFPathFinder.patchList().empty()) {
     mPMFPathFinder.writePatchedPMF(ui->lineEditOutput->text() + ".patched");
   }
-  ui->pushButtonFind->setText(tr("Find"));
-  ui->pushButtonFind->setEnabled(true);
+}
+
+void FindPathTab::updatePatchedPath() {
+  qDebug() << "Calling" << Q_FUNC_INFO;
+  // a search is still running in the background
+  if (!ui->pushButtonFind->isEnabled())
+    return;
+  const auto tmp_patchList = mPatchTable->patchList();
+  std::vector<GridDataPatch> patchList(tmp_patchList.begin(),
+                                       tmp_patchList.end());
+  // only the path found by LPA* can be repaired without a full search
+  if (mPMFPathFinder.updatePatchList(patchList)) {
+    saveResults();
+    if (mPMFPathFinder.histogram().dimension() == 2) {
+      plotPathOnPMF();
+    }
+  }
 }
 
 void FindPathTab::plotPathOnPMF() {
@@ -216,6 +311,7 @@ void FindPathTab::showAddPatchDialog() {
       length[i] = aDialog.length(i);
     }
     addPatch(aDialog.center(), length, aDialog.value());
+    updatePatchedPath();
   }
 }
 
@@ -228,6 +324,7 @@ void FindPathTab::removePatch() {
     mPatchTable->removeRows(row, 1, QModelIndex());
   }
   ui->tableViewPatch->setCurrentIndex(ui->tableViewPatch->currentIndex());
+  updatePatchedPath();
 }
 
 FindPathCLI::FindPathCLI(QObject *parent): CLIObject(parent)
@@ -246,6 +343,33 @@ bool FindPathCLI::readJSON(const QString &jsonFilename)
   mStart = mLoadDoc["Start"].toString();
   mEnd = mLoadDoc["End"].toString();
   mAlgorithm = mLoadDoc["Algorithm"].toInt();
+  mMode = mLoadDoc["Mode"].toInt(static_cast<int>(Graph::FindPathMode::MFEPMode));
+  // number of threads for the delta-stepping algorithm and the batched
+  // queries, and the bucket width of delta-stepping, where 0 means automatic
+  mNumThreads = mLoadDoc["Threads"].toInt(0);
+  mBucketWidth = mLoadDoc["Bucket width"].toDouble(0);
+  // number of coarse levels of the multi-resolution search (0 disables it),
+  // the width in bins of the corridor around the coarse path, and whether to
+  // compare the result with the search over the whole grid
+  mNumLevels = mLoadDoc["Multi-resolution levels"].toInt(0);
+  mCorridorWidth = mLoadDoc["Corridor width"].toInt(2);
+  mCheckFullSearch = mLoadDoc["Check full search"].toBool(false);
+  // optional refinement of the path by the string method on the
+  // interpolated PMF
+  const QJsonObject jsonString = mLoadDoc["String method"].toObject();
+  mStringImages = jsonString["Images"].toInt(0);
+  mStringIterations = jsonString["Iterations"].toInt(0);
+  mStringStepSize = jsonString["Step size"].toDouble(0);
+  mStringTolerance = jsonString["Tolerance"].toDouble(1e-4);
+  // the bins above the optional energy cap are excluded from the search
+  mEnergyCap = mLoadDoc["Energy cap"].toDouble(
+      std::numeric_limits<double>::infinity());
+  // optional alternative pathways by Yen's k-shortest paths algorithm
+  const QJsonObject jsonAlternatives =
+      mLoadDoc["Alternative paths"].toObject();
+  mNumAlternativePaths = jsonAlternatives["Number"].toInt(0);
+  mMaxSharedFraction = jsonAlternatives["Max shared fraction"].toDouble(1.0);
+  mMaxCandidatePaths = jsonAlternatives["Max candidates"].toInt(0);
   const QJsonArray jsonPatches = mLoadDoc["Patches"].toArray();
   for (const auto &a: jsonPatches) {
     const auto jsonPatch = a.toObject();
@@ -256,14 +380,37 @@ bool FindPathCLI::readJSON(const QString &jsonFilename)
                                        splitStringToNumbers<double>(patchLength),
                                        patchValue});
   }
+  // optional list of queries like [{"Start": "0 0", "End": "10 10"}], which
+  // replaces the single start and end
+  const QJsonArray jsonQueries = mLoadDoc["Queries"].toArray();
+  for (const auto &a : jsonQueries) {
+    const auto jsonQuery = a.toObject();
+    mQueryStarts.push_back(
+        splitStringToNumbers<double>(jsonQuery["Start"].toString()));
+    mQueryEnds.push_back(
+        splitStringToNumbers<double>(jsonQuery["End"].toString()));
+  }
+  // optional regions around (or instead of) the starting and ending points
+  mStartRegion = readRegionFromJSON(mLoadDoc["Start region"].toObject());
+  mEndRegion = readRegionFromJSON(mLoadDoc["End region"].toObject());
   HistogramScalar<double> inputPMFHistogram;
-  const Graph::FindPathMode mode = Graph::FindPathMode::MFEPMode;
+  const Graph::FindPathMode mode = static_cast<Graph::FindPathMode>(mMode);
   if (inputPMFHistogram.readFromFile(mInputPMF)) {
     // TODO: check if the input is valid!
     mPMFPathFinder.setup(inputPMFHistogram, mPatchList,
                          splitStringToNumbers<double>(mStart),
                          splitStringToNumbers<double>(mEnd),
                          mode, static_cast<Graph::FindPathAlgorithm>(mAlgorithm));
+    mPMFPathFinder.setDeltaStepping(mNumThreads, mBucketWidth);
+    mPMFPathFinder.setRegions(mStartRegion, mEndRegion);
+    mPMFPathFinder.setBatchQueries(mQueryStarts, mQueryEnds);
+    mPMFPathFinder.setMultiResolution(mNumLevels, mCorridorWidth,
+                                      mCheckFullSearch);
+    mPMFPathFinder.setStringMethod(mStringImages, mStringIterations,
+                                   mStringStepSize, mStringTolerance);
+    mPMFPathFinder.setAlternativePaths(mNumAlternativePaths,
+                                       mMaxSharedFraction, mMaxCandidatePaths);
+    mPMFPathFinder.setEnergyCap(mEnergyCap);
     return true;
   } else {
     qWarning() << "Failed to read from" << mInputPMF;
@@ -285,14 +432,58 @@ void FindPathCLI::findPathDone(const PMFPathFinder &result)
 {
   qDebug() << "Calling" << Q_FUNC_INFO;
   mPMFPathFinder = result;
-  mPMFPathFinder.writePath(mOutputPrefix + ".path");
-  mPMFPathFinder.writeVisitedRegion(mOutputPrefix + ".region");
+  if (!mQueryStarts.empty()) {
+    mPMFPathFinder.writeBatchPaths(mOutputPrefix);
+  } else {
+    mPMFPathFinder.writePath(mOutputPrefix + ".path");
+    mPMFPathFinder.writeVisitedRegion(mOutputPrefix + ".region");
+    if (!mPMFPathFinder.refinedPathPosition().empty()) {
+      mPMFPathFinder.writeRefinedPath(mOutputPrefix + ".string");
+    }
+    if (!mPMFPathFinder.alternativeResults().empty()) {
+      mPMFPathFinder.writeAlternativePaths(mOutputPrefix);
+    }
+  }
   if (!mPMFPathFinder.patchList().empty()) {
     mPMFPathFinder.writePatchedPMF(mOutputPrefix + ".patched");
   }
   emit allDone();
 }
 
+MergeTreeCLI::MergeTreeCLI(QObject *parent): CLIObject(parent)
+{
+
+}
+
+bool MergeTreeCLI::readJSON(const QString &jsonFilename)
+{
+  if (!CLIObject::readJSON(jsonFilename)) {
+    return false;
+  }
+  mInputPMF = mLoadDoc["Input PMF"].toString();
+  mOutputPrefix = mLoadDoc["Output"].toString();
+  return true;
+}
+
+void MergeTreeCLI::start()
+{
+  HistogramScalar<double> inputPMFHistogram;
+  if (inputPMFHistogram.readFromFile(mInputPMF)) {
+    PMFPathFinder finder(inputPMFHistogram, std::vector<GridDataPatch>());
+    const MergeTree tree = finder.buildMergeTree();
+    finder.writeMergeTree(mOutputPrefix + ".tree", tree);
+    finder.writeBarrierMatrix(mOutputPrefix + ".barrier", tree);
+  } else {
+    qWarning() << "Failed to read from" << mInputPMF;
+  }
+  emit allDone();
+}
+
+MergeTreeCLI::~MergeTreeCLI()
+{
+
+}
+
 PathPMFInPMFCLI::PathPMFInPMFCLI(QObject* parent): CLIObject(parent)
 {
 
@@ -38,7 +38,9 @@ public:
   explicit FindPathTab(QWidget *parent = nullptr);
   ~FindPathTab();
   void setupAvailableAlgorithms();
+  void setupAvailableModes();
   Graph::FindPathAlgorithm selectedAlgorithm() const;
+  Graph::FindPathMode selectedMode() const;
   void addPatch(const QString &center, const QVector<double> &length,
                 const double value);
 
@@ -53,12 +55,15 @@ public slots:
   void removePatch();
 
 private:
+  void saveResults();
+  void updatePatchedPath();
   Ui::FindPathTab *ui;
   PatchTableModel *mPatchTable;
   HistogramPMF mPMF;
   PMFPathFinderThread mPMFPathFinderThread;
   PMFPathFinder mPMFPathFinder;
   QMap<QString, Graph::FindPathAlgorithm> mAvailableAlgorithms;
+  QMap<QString, Graph::FindPathMode> mAvailableModes;
 };
 
 class FindPathCLI: public CLIObject {
@@ -77,12 +82,42 @@ private:
   QString mStart;
   QString mEnd;
   int mAlgorithm;
+  int mMode;
+  int mNumThreads;
+  double mBucketWidth;
+  int mNumLevels;
+  int mCorridorWidth;
+  bool mCheckFullSearch;
+  int mStringImages;
+  int mStringIterations;
+  double mStringStepSize;
+  double mStringTolerance;
+  int mNumAlternativePaths;
+  double mMaxSharedFraction;
+  int mMaxCandidatePaths;
+  double mEnergyCap;
+  GridDataRegion mStartRegion;
+  GridDataRegion mEndRegion;
+  std::vector<std::vector<double>> mQueryStarts;
+  std::vector<std::vector<double>> mQueryEnds;
   std::vector<GridDataPatch> mPatchList;
   HistogramPMF mPMF;
   PMFPathFinderThread mPMFPathFinderThread;
   PMFPathFinder mPMFPathFinder;
 };
 
+class MergeTreeCLI: public CLIObject {
+  Q_OBJECT
+public:
+  explicit MergeTreeCLI(QObject *parent = nullptr);
+  virtual bool readJSON(const QString &jsonFilename) override;
+  virtual void start() override;
+  ~MergeTreeCLI();
+private:
+  QString mInputPMF;
+  QString mOutputPrefix;
+};
+
 class PathPMFInPMFCLI: public CLIObject {
   Q_OBJECT
 public:
@@ -40,6 +40,26 @@ void runTests() {
   testSPFA();
   qDebug() << "==============SPFA2==============";
   testSPFA2();
+  qDebug() << "==============A*==============";
+  testAStar();
+  qDebug() << "==============A* on a PMF==============";
+  testPMFPathFinderAStar();
+  qDebug() << "==============Bidirectional Dijkstra==============";
+  testBidirectionalDijkstra();
+  qDebug() << "==============Delta-stepping==============";
+  testDeltaStepping();
+  qDebug() << "==============Batched Dijkstra==============";
+  testBatchDijkstra();
+  qDebug() << "==============Merge tree==============";
+  testMergeTree();
+  qDebug() << "==============LPA*==============";
+  testLPAStar();
+  qDebug() << "==============K shortest paths==============";
+  testKShortestPaths();
+  qDebug() << "==============String method==============";
+  testStringMethod();
+  qDebug() << "==============Metadynamics FFT==============";
+  testMetadynamicsFFT();
 }
 
 void initTypes() {
@@ -89,6 +109,11 @@ int runConsole(int argc, char *argv[]) {
       "sumhills",
       QCoreApplication::translate(
           "main", "sum hills from a colvars metadynamics trajectory."));
+  const QCommandLineOption mergeTreeOption(
+      "mergetree",
+      QCoreApplication::translate(
+          "main", "build the merge tree of a multidimensional PMF and compute "
+                  "the barriers between all pairs of minima."));
   const QCommandLineOption pathPMFOption("pathpmf", QCoreApplication::translate("main", "find the PMF along a path in a multi-dimensional PMF"));
   parser.addOption(projectOption);
   parser.addOption(reweightOption);
@@ -96,6 +121,7 @@ int runConsole(int argc, char *argv[]) {
   parser.addOption(namdlogOption);
   parser.addOption(mfepOption);
   parser.addOption(sumhillsOption);
+  parser.addOption(mergeTreeOption);
   parser.addOption(pathPMFOption);
   parser.addPositionalArgument("jsonfile", "the json configuration file");
 
@@ -132,6 +158,8 @@ int runConsole(int argc, char *argv[]) {
     CLI = new FindPathCLI(&a);
   } else if (parser.isSet(sumhillsOption)) {
     CLI = new MetadynamicsCLI(&a);
+  } else if (parser.isSet(mergeTreeOption)) {
+    CLI = new MergeTreeCLI(&a);
   } else if (parser.isSet(pathPMFOption)) {
     CLI = new PathPMFInPMFCLI(&a);
   }
@@ -25,8 +25,6 @@ MetadynamicsTab::MetadynamicsTab(QWidget *parent)
           &MetadynamicsTab::addAxis);
   connect(ui->pushButtonRemoveAxis, &QPushButton::clicked, this,
           &MetadynamicsTab::removeAxis);
-  connect(&mWorkerThread, &SumHillsThread::stridedResult, this,
-          &MetadynamicsTab::intermediate);
   connect(&mWorkerThread, &SumHillsThread::done, this, &MetadynamicsTab::done);
   connect(&mWorkerThread, &SumHillsThread::progress, this,
           &MetadynamicsTab::progress);
@@ -38,49 +36,17 @@ MetadynamicsTab::~MetadynamicsTab() { delete ui; }
 
 void MetadynamicsTab::loadTrajectory() {
   qDebug() << "Calling" << Q_FUNC_INFO;
-  const QString inputFileName = QFileDialog::getOpenFileName(
-      this, tr("Open NAMD log file"), "", tr("All Files (*)"));
-  if (inputFileName.isEmpty())
+  // multiple walkers have one trajectory each
+  const QStringList inputFileNames = QFileDialog::getOpenFileNames(
+      this, tr("Open hills trajectory files"), "", tr("All Files (*)"));
+  if (inputFileNames.isEmpty())
     return;
-  ui->lineEditInputTrajectory->setText(inputFileName);
+  ui->lineEditInputTrajectory->setText(inputFileNames.join(";"));
 }
 
-void MetadynamicsTab::intermediate(qint64 step, HistogramScalar<double> PMF,
-                                   HistogramVector<double> gradients) {
+void MetadynamicsTab::done() {
   qDebug() << "Calling" << Q_FUNC_INFO;
-  const QString outputPMFFilename =
-      ui->lineEditOutput->text() + "_" + QString::number(step) + ".pmf";
-  const QString outputGradFilename =
-      ui->lineEditOutput->text() + "_" + QString::number(step) + ".grad";
-  if (ui->checkBoxWellTempered->isChecked()) {
-    const double temperature = ui->lineEditTemperature->text().toDouble();
-    const double deltaT = ui->lineEditDeltaT->text().toDouble();
-    Metadynamics::writePMF(PMF, outputPMFFilename, true, deltaT, temperature);
-    Metadynamics::writeGradients(gradients, outputGradFilename, true, deltaT,
-                                 temperature);
-  } else {
-    Metadynamics::writePMF(PMF, outputPMFFilename, false, 0.0, 1.0);
-    Metadynamics::writeGradients(gradients, outputGradFilename, false, 0.0,
-                                 1.0);
-  }
-}
-
-void MetadynamicsTab::done(HistogramScalar<double> PMF,
-                           HistogramVector<double> gradients) {
-  qDebug() << "Calling" << Q_FUNC_INFO;
-  const QString outputPMFFilename = ui->lineEditOutput->text() + ".pmf";
-  const QString outputGradFilename = ui->lineEditOutput->text() + ".grad";
-  if (ui->checkBoxWellTempered->isChecked()) {
-    const double temperature = ui->lineEditTemperature->text().toDouble();
-    const double deltaT = ui->lineEditDeltaT->text().toDouble();
-    Metadynamics::writePMF(PMF, outputPMFFilename, true, deltaT, temperature);
-    Metadynamics::writeGradients(gradients, outputGradFilename, true, deltaT,
-                                 temperature);
-  } else {
-    Metadynamics::writePMF(PMF, outputPMFFilename, false, 0.0, 1.0);
-    Metadynamics::writeGradients(gradients, outputGradFilename, false, 0.0,
-                                 1.0);
-  }
+  // the results are already written by the worker thread
   ui->pushButtonRun->setEnabled(true);
   ui->pushButtonRun->setText(tr("Run"));
 }
@@ -96,13 +62,25 @@ void MetadynamicsTab::runSumHills() {
   qDebug() << "Calling" << Q_FUNC_INFO;
   const std::vector<Axis> ax = mTableModel->targetAxis();
   const qint64 strides = std::nearbyint(ui->doubleSpinBoxStrides->value());
-  const QString &inputFilename = ui->lineEditInputTrajectory->text();
-  if (ax.empty() || inputFilename.size() == 0) {
+  const QStringList inputFilenames = ui->lineEditInputTrajectory->text().split(
+      ";", Qt::SkipEmptyParts);
+  if (ax.empty() || inputFilenames.isEmpty()) {
     // TODO: handle error
     return;
   }
   ui->pushButtonRun->setEnabled(false);
-  mWorkerThread.sumHills(ax, strides, inputFilename);
+  mWorkerThread.setNumThreads(ui->spinBoxThreads->value());
+  mWorkerThread.setGradients(ui->checkBoxGradients->isChecked());
+  mWorkerThread.setFFT(ui->checkBoxFFT->isChecked());
+  if (ui->checkBoxWellTempered->isChecked()) {
+    const double temperature = ui->lineEditTemperature->text().toDouble();
+    const double deltaT = ui->lineEditDeltaT->text().toDouble();
+    mWorkerThread.setOutput(ui->lineEditOutput->text(), true, deltaT,
+                            temperature);
+  } else {
+    mWorkerThread.setOutput(ui->lineEditOutput->text());
+  }
+  mWorkerThread.sumHills(ax, strides, inputFilenames);
 }
 
 void MetadynamicsTab::toggleWellTempered(bool enableWellTempered) {
@@ -134,7 +112,7 @@ MetadynamicsCLI::MetadynamicsCLI(QObject *parent): CLIObject(parent)
 {
   connect(&mWorkerThread, &SumHillsThread::progress, this, &MetadynamicsCLI::progress);
   connect(&mWorkerThread, &SumHillsThread::done, this, &MetadynamicsCLI::done);
-  connect(&mWorkerThread, &SumHillsThread::stridedResult, this, &MetadynamicsCLI::intermediate);
+  connect(&mWorkerThread, &SumHillsThread::updated, this, &MetadynamicsCLI::updated);
   connect(&mWorkerThread, &SumHillsThread::error, this, &MetadynamicsCLI::error);
 }
 
@@ -143,7 +121,15 @@ bool MetadynamicsCLI::readJSON(const QString &jsonFilename)
   if (!CLIObject::readJSON(jsonFilename)) {
     return false;
   }
-  mTrajectoryFilename = mLoadDoc["Trajectory"].toString();
+  // a list of trajectories for multiple walkers
+  if (mLoadDoc["Trajectory"].isArray()) {
+    const QJsonArray jsonTrajectories = mLoadDoc["Trajectory"].toArray();
+    for (const auto &i : jsonTrajectories) {
+      mTrajectoryFilenames.append(i.toString());
+    }
+  } else {
+    mTrajectoryFilenames.append(mLoadDoc["Trajectory"].toString());
+  }
   mOutputPrefix = mLoadDoc["Output"].toString();
   const QJsonArray jsonAxes = mLoadDoc["Axes"].toArray();
   for (int i = 0; i < jsonAxes.size(); ++i) {
@@ -161,12 +147,38 @@ bool MetadynamicsCLI::readJSON(const QString &jsonFilename)
     mTemperature = mLoadDoc["Temperature"].toDouble();
   }
   mStride = mLoadDoc["Stride"].toInt();
+  // each hill is summed within this number of sigmas from its center
+  mHillCutoff = mLoadDoc["Hill cutoff"].toDouble(std::sqrt(200.0));
+  // 0 uses all but one of the cores
+  mNumThreads = std::max(mLoadDoc["Threads"].toInt(0), 0);
+  // resume from and update this checkpoint
+  mCheckpointFilename = mLoadDoc["Checkpoint"].toString();
+  // keep summing the newly appended hills until the program is killed
+  mFollow = mLoadDoc["Follow"].toBool(false);
+  mFollowInterval = std::max(mLoadDoc["Follow interval"].toInt(1000), 1);
+  // optionally sum the hills by FFT if all of them have the same sigmas,
+  // which approximates the off-center hills
+  mFFT = mLoadDoc["FFT"].toBool(false);
+  mSubgridSpreading = mLoadDoc["FFT subgrid spreading"].toBool(true);
+  // only write the PMF, which skips computing the gradients
+  mGradients = mLoadDoc["Gradients"].toBool(true);
   return true;
 }
 
 void MetadynamicsCLI::start()
 {
-  mWorkerThread.sumHills(mAxes, mStride, mTrajectoryFilename);
+  mWorkerThread.setHillCutoff(mHillCutoff);
+  mWorkerThread.setNumThreads(mNumThreads);
+  mWorkerThread.setCheckpoint(mCheckpointFilename);
+  mWorkerThread.setFollow(mFollow, mFollowInterval);
+  mWorkerThread.setFFT(mFFT, mSubgridSpreading);
+  mWorkerThread.setGradients(mGradients);
+  if (mIsWellTempered) {
+    mWorkerThread.setOutput(mOutputPrefix, true, mDeltaT, mTemperature);
+  } else {
+    mWorkerThread.setOutput(mOutputPrefix);
+  }
+  mWorkerThread.sumHills(mAxes, mStride, mTrajectoryFilenames);
 }
 
 MetadynamicsCLI::~MetadynamicsCLI()
@@ -185,37 +197,15 @@ void MetadynamicsCLI::error(QString msg)
   emit allDone();
 }
 
-void MetadynamicsCLI::intermediate(qint64 step, HistogramScalar<double> PMF, HistogramVector<double> gradients)
+void MetadynamicsCLI::updated(qint64 step)
 {
   qDebug() << "Calling" << Q_FUNC_INFO;
-  const QString outputPMFFilename =
-      mOutputPrefix + "_" + QString::number(step) + ".pmf";
-  const QString outputGradFilename =
-      mOutputPrefix + "_" + QString::number(step) + ".grad";
-  if (mIsWellTempered) {
-    Metadynamics::writePMF(PMF, outputPMFFilename, true, mDeltaT, mTemperature);
-    Metadynamics::writeGradients(gradients, outputGradFilename, true, mDeltaT,
-                                 mTemperature);
-  } else {
-    Metadynamics::writePMF(PMF, outputPMFFilename, false, 0.0, 1.0);
-    Metadynamics::writeGradients(gradients, outputGradFilename, false, 0.0,
-                                 1.0);
-  }
+  qInfo() << "Metadynamics sum hills: updated to step" << step;
 }
 
-void MetadynamicsCLI::done(HistogramScalar<double> PMF, HistogramVector<double> gradients)
+void MetadynamicsCLI::done()
 {
   qDebug() << "Calling" << Q_FUNC_INFO;
-  const QString outputPMFFilename = mOutputPrefix + ".pmf";
-  const QString outputGradFilename = mOutputPrefix + ".grad";
-  if (mIsWellTempered) {
-    Metadynamics::writePMF(PMF, outputPMFFilename, true, mDeltaT, mTemperature);
-    Metadynamics::writeGradients(gradients, outputGradFilename, true, mDeltaT,
-                                 mTemperature);
-  } else {
-    Metadynamics::writePMF(PMF, outputPMFFilename, false, 0.0, 1.0);
-    Metadynamics::writeGradients(gradients, outputGradFilename, false, 0.0,
-                                 1.0);
-  }
+  // the results are already written by the worker thread
   emit allDone();
 }
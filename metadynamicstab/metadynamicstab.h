@@ -21,8 +21,7 @@ public:
 public slots:
   void loadTrajectory();
   void saveFile();
-  void intermediate(qint64 step, HistogramScalar<double> PMF, HistogramVector<double> gradients);
-  void done(HistogramScalar<double> PMF, HistogramVector<double> gradients);
+  void done();
   void runSumHills();
   void toggleWellTempered(bool enableWellTempered);
   void addAxis();
@@ -44,16 +43,24 @@ public:
 public slots:
   void progress(int percent);
   void error(QString msg);
-  void intermediate(qint64 step, HistogramScalar<double> PMF, HistogramVector<double> gradients);
-  void done(HistogramScalar<double> PMF, HistogramVector<double> gradients);
+  void updated(qint64 step);
+  void done();
 private:
-  QString mTrajectoryFilename;
+  QStringList mTrajectoryFilenames;
   QString mOutputPrefix;
   std::vector<Axis> mAxes;
   qint64 mStride;
   bool mIsWellTempered;
   double mDeltaT;
   double mTemperature;
+  double mHillCutoff;
+  size_t mNumThreads;
+  QString mCheckpointFilename;
+  bool mFollow;
+  unsigned long mFollowInterval;
+  bool mFFT;
+  bool mSubgridSpreading;
+  bool mGradients;
   SumHillsThread mWorkerThread;
 };
 
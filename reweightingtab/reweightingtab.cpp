@@ -215,7 +215,9 @@ void ReweightingTab::help() {
   // TODO
 }
 
-ReweightingCLI::ReweightingCLI(QObject *parent) : CLIObject(parent) {
+ReweightingCLI::ReweightingCLI(QObject *parent)
+    : CLIObject(parent), mNumThreads(0), mShiftWeights(false), mStepColumn(0),
+      mWellTempered(false), mBiasTemperature(0.0), mTemperature(1.0) {
   connect(&mWorkerThread, &ReweightingThread::error, this,
           &ReweightingCLI::reweightingError);
   connect(&mWorkerThread, &ReweightingThread::progress, this,
@@ -239,55 +241,111 @@ void ReweightingCLI::reweightingDone() {
   emit allDone();
 }
 
+// read the columns, the axes and the output file of a reweighting target
+static bool readReweightingTarget(const QJsonObject &json,
+                                  ReweightingTarget &target) {
+  target.outputFileName = json["Output"].toString();
+  const QJsonArray jsonTocolumns = json["To columns"].toArray();
+  const QJsonArray jsonReweightingAxes = json["Reweighting Axes"].toArray();
+  for (const auto &i : jsonTocolumns) {
+    target.columns.push_back(i.toInt());
+  }
+  for (const auto &a : jsonReweightingAxes) {
+    const auto nested_json = a.toObject();
+    const int target_column = nested_json["Target Column"].toInt();
+    qDebug() << "Read target column: " << target_column;
+    const auto find_result = std::find(target.columns.begin(),
+                                       target.columns.end(), target_column);
+    if (find_result != target.columns.end()) {
+      const double lower_bound = nested_json["Lower bound"].toDouble();
+      const double upper_bound = nested_json["Upper bound"].toDouble();
+      const size_t nbins = std::nearbyint((upper_bound - lower_bound) /
+                                          nested_json["Width"].toDouble());
+      target.axes.push_back(Axis(lower_bound, upper_bound, nbins));
+    } else {
+      qDebug() << "Target column not found!";
+      qDebug() << "Problem json data: " << nested_json;
+      return false;
+    }
+  }
+  return true;
+}
+
 bool ReweightingCLI::readJSON(const QString &jsonFilename) {
   if (!CLIObject::readJSON(jsonFilename)) {
     return false;
   }
   const QString inputFilename = mLoadDoc["Input"].toString();
-  mOutputFilename = mLoadDoc["Output"].toString();
   const QJsonArray jsonFromColumns = mLoadDoc["From columns"].toArray();
-  const QJsonArray jsonTocolumns = mLoadDoc["To columns"].toArray();
   const QString unit = mLoadDoc["Unit"].toString();
   const double temperature = mLoadDoc["Temperature"].toDouble();
   mConvertToPMF = mLoadDoc["Convert to PMF"].toBool();
+  // 0 uses all but one of the cores
+  mNumThreads = std::max(mLoadDoc["Threads"].toInt(0), 0);
+  // scale the probabilities by exp(Fmin / kbT) to avoid overflow
+  mShiftWeights = mLoadDoc["Shift weights"].toBool(false);
   const QJsonArray jsonTrajectories = mLoadDoc["Trajectories"].toArray();
-  const QJsonArray jsonReweightingAxes = mLoadDoc["Reweighting Axes"].toArray();
   for (const auto &i : jsonTrajectories) {
     mFileList.push_back(i.toString());
   }
   for (const auto &i : jsonFromColumns) {
     mFromColumns.push_back(i.toInt());
   }
-  for (const auto &i : jsonTocolumns) {
-    mToColumns.push_back(i.toInt());
+  // several projections of the same trajectories are reweighted in a single
+  // pass, or the target is read from the top level
+  const QJsonArray jsonTargets = mLoadDoc["Targets"].toArray();
+  if (jsonTargets.isEmpty()) {
+    ReweightingTarget target;
+    if (!readReweightingTarget(mLoadDoc.object(), target)) {
+      return false;
+    }
+    mTargets.push_back(target);
+  } else {
+    for (const auto &t : jsonTargets) {
+      ReweightingTarget target;
+      if (!readReweightingTarget(t.toObject(), target)) {
+        return false;
+      }
+      mTargets.push_back(target);
+    }
   }
-  for (const auto &a : jsonReweightingAxes) {
-    const auto nested_json = a.toObject();
-    const int target_column = nested_json["Target Column"].toInt();
-    qDebug() << "Read target column: " << target_column;
-    const auto find_result =
-        std::find(mToColumns.begin(), mToColumns.end(), target_column);
-    if (find_result != mToColumns.end()) {
-      const double lower_bound = nested_json["Lower bound"].toDouble();
-      const double upper_bound = nested_json["Upper bound"].toDouble();
-      const size_t nbins = std::nearbyint((upper_bound - lower_bound) /
-                                          nested_json["Width"].toDouble());
-      mTargetAxis.push_back(Axis(lower_bound, upper_bound, nbins));
-    } else {
-      qDebug() << "Target column not found!";
-      qDebug() << "Problem json data: " << nested_json;
+  // reweight by the time-dependent bias of the hills instead of the PMF
+  mHillsFilename = mLoadDoc["Hills"].toString();
+  if (!mHillsFilename.isEmpty()) {
+    const QJsonArray jsonHillsAxes = mLoadDoc["Hills axes"].toArray();
+    for (const auto &a : jsonHillsAxes) {
+      const auto jsonAxis = a.toObject();
+      const double lowerBound = jsonAxis["Lower bound"].toDouble();
+      const double upperBound = jsonAxis["Upper bound"].toDouble();
+      const size_t bins =
+          std::nearbyint((upperBound - lowerBound) / jsonAxis["Width"].toDouble());
+      const bool periodic = jsonAxis["Periodic"].toBool();
+      mHillsAxes.push_back(Axis(lowerBound, upperBound, bins, periodic));
+    }
+    if (mHillsAxes.size() != mFromColumns.size()) {
+      qDebug() << "The number of hills axes does not match the from columns!";
       return false;
     }
+    mStepColumn = mLoadDoc["Step column"].toInt(0);
+    mWellTempered = mLoadDoc["Well tempered"].toBool(false);
+    mBiasTemperature = mLoadDoc["Bias temperature"].toDouble();
+    mTemperature = temperature;
+  } else {
+    mInputPMF.readFromFile(inputFilename);
   }
-  mInputPMF.readFromFile(inputFilename);
   mKbT = kbT(temperature, unit);
   return true;
 }
 
 void ReweightingCLI::start() {
   qDebug() << "Calling" << Q_FUNC_INFO;
-  mWorkerThread.reweighting(mFileList, mOutputFilename, mInputPMF, mFromColumns,
-                            mToColumns, mTargetAxis, mKbT, mConvertToPMF);
+  mWorkerThread.setNumThreads(mNumThreads);
+  mWorkerThread.setShiftWeights(mShiftWeights);
+  mWorkerThread.setMetadynamicsBias(mHillsFilename, mHillsAxes, mStepColumn,
+                                    mWellTempered, mBiasTemperature,
+                                    mTemperature);
+  mWorkerThread.reweighting(mFileList, mInputPMF, mFromColumns, mTargets, mKbT,
+                            mConvertToPMF);
 }
 
 ReweightingCLI::~ReweightingCLI() { qDebug() << "Calling" << Q_FUNC_INFO; }
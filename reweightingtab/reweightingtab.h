@@ -74,13 +74,19 @@ public slots:
 
 private:
   QStringList mFileList;
-  QString mOutputFilename;
   HistogramPMF mInputPMF;
   std::vector<int> mFromColumns;
-  std::vector<int> mToColumns;
-  std::vector<Axis> mTargetAxis;
+  std::vector<ReweightingTarget> mTargets;
   double mKbT;
   bool mConvertToPMF;
+  size_t mNumThreads;
+  bool mShiftWeights;
+  QString mHillsFilename;
+  std::vector<Axis> mHillsAxes;
+  int mStepColumn;
+  bool mWellTempered;
+  double mBiasTemperature;
+  double mTemperature;
   ReweightingThread mWorkerThread;
 };
 
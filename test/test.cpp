@@ -18,6 +18,9 @@
 */
 
 #include "test/test.h"
+#include "base/helper.h"
+
+#include <random>
 
 void testGraph() {
   std::vector<Graph::Edge> edges{
@@ -35,8 +38,10 @@ void testGraph() {
   std::cout << '\n';
 }
 
-void testDijkstra() {
-  std::vector<Graph::Edge> edges3{
+// the directed edges of the 12 vertices of a 4x3 grid shared by the tests
+// of the path finding algorithms
+static std::vector<Graph::Edge> gridEdges() {
+  return {
       {0, 1, 4},   {0, 3, 4},   {1, 0, 1},   {1, 2, 1},  {1, 4, 10}, {2, 1, 4},
       {2, 5, 3},   {3, 0, 1},   {3, 4, 10},  {3, 6, 1},  {4, 3, 4},  {4, 1, 4},
       {4, 5, 3},   {4, 7, 10},  {5, 4, 10},  {5, 2, 1},  {5, 8, 1},  {6, 3, 4},
@@ -44,8 +49,11 @@ void testDijkstra() {
       {8, 7, 10},  {8, 5, 3},   {8, 11, 1},  {9, 6, 1},  {9, 10, 1}, {10, 9, 2},
       {10, 7, 10}, {10, 11, 1}, {11, 10, 1}, {11, 8, 1},
   };
+}
+
+void testDijkstra() {
   Graph graph(12, true);
-  graph.setEdges(edges3);
+  graph.setEdges(gridEdges());
   graph.printGraph(std::cout);
   std::cout << "After sorting lists:\n";
   graph.sortByWeight();
@@ -54,16 +62,8 @@ void testDijkstra() {
 }
 
 void testSPFA() {
-  std::vector<Graph::Edge> edges3{
-      {0, 1, 4},   {0, 3, 4},   {1, 0, 1},   {1, 2, 1},  {1, 4, 10}, {2, 1, 4},
-      {2, 5, 3},   {3, 0, 1},   {3, 4, 10},  {3, 6, 1},  {4, 3, 4},  {4, 1, 4},
-      {4, 5, 3},   {4, 7, 10},  {5, 4, 10},  {5, 2, 1},  {5, 8, 1},  {6, 3, 4},
-      {6, 7, 10},  {6, 9, 2},   {7, 6, 1},   {7, 4, 10}, {7, 8, 1},  {7, 10, 1},
-      {8, 7, 10},  {8, 5, 3},   {8, 11, 1},  {9, 6, 1},  {9, 10, 1}, {10, 9, 2},
-      {10, 7, 10}, {10, 11, 1}, {11, 10, 1}, {11, 8, 1},
-  };
   Graph graph(12, true);
-  graph.setEdges(edges3);
+  graph.setEdges(gridEdges());
   graph.printGraph(std::cout);
   std::cout << "After sorting lists:\n";
   graph.sortByWeight();
@@ -89,6 +89,228 @@ void testSPFA2() {
   graph.SPFA(0, 9, Graph::FindPathMode::MFEPMode).dump();
 }
 
+void testAStar() {
+  Graph graph(12, true);
+  graph.setEdges(gridEdges());
+  // the minimum weight is 1, and the vertices form a 4x3 grid
+  std::vector<double> heuristic(12, 0.0);
+  for (size_t i = 0; i < heuristic.size(); ++i) {
+    heuristic[i] = std::abs(int(i / 3) - 3) + std::abs(int(i % 3) - 0);
+  }
+  graph.AStar(0, 9, Graph::FindPathMode::SumOfEdges, heuristic).dump();
+  graph.Dijkstra(0, 9, Graph::FindPathMode::SumOfEdges).dump();
+}
+
+void testPMFPathFinderAStar() {
+  // a PMF on a non-square grid whose minimum is positive, so that the
+  // heuristic of A* is not zero
+  const std::vector<Axis> axes{Axis(0, 10, 20), Axis(-3, 3, 9)};
+  HistogramScalar<double> pmf(axes);
+  const auto &point_table = pmf.pointTable();
+  for (size_t i = 0; i < pmf.histogramSize(); ++i) {
+    const double x = point_table[0][i];
+    const double y = point_table[1][i];
+    bool in_grid = true;
+    const size_t addr = pmf.address({x, y}, &in_grid);
+    pmf[addr] = 1.0 + 0.1 * (x - 5.0) * (x - 5.0) +
+                2.0 * std::exp(-(x - 5.0) * (x - 5.0) - y * y) +
+                0.5 * std::cos(2.0 * y);
+  }
+  const std::vector<double> pos_start{0.75, -2.5};
+  const std::vector<double> pos_end{9.25, 1.5};
+  PMFPathFinder astar(pmf, {}, pos_start, pos_end,
+                      Graph::FindPathMode::SumOfEdges,
+                      Graph::FindPathAlgorithm::AStar);
+  PMFPathFinder dijkstra(pmf, {}, pos_start, pos_end,
+                         Graph::FindPathMode::SumOfEdges,
+                         Graph::FindPathAlgorithm::Dijkstra);
+  astar.findPath();
+  dijkstra.findPath();
+  const auto astar_result = astar.result();
+  const auto dijkstra_result = dijkstra.result();
+  const double astar_distance =
+      astar_result.mDistances[astar_result.mPathNodes.back()];
+  const double dijkstra_distance =
+      dijkstra_result.mDistances[dijkstra_result.mPathNodes.back()];
+  qDebug() << "A* distance:" << astar_distance
+           << "Dijkstra distance:" << dijkstra_distance;
+  qDebug() << "A* finds the shortest path:"
+           << boolToString(almost_equal(astar_distance, dijkstra_distance));
+}
+
+void testBidirectionalDijkstra() {
+  Graph graph(12, true);
+  graph.setEdges(gridEdges());
+  graph.BidirectionalDijkstra(0, 11, Graph::FindPathMode::SumOfEdges).dump();
+  graph.BidirectionalDijkstra(0, 11, Graph::FindPathMode::MaximumEdges).dump();
+  graph.Dijkstra(0, 11, Graph::FindPathMode::MaximumEdges).dump();
+}
+
+void testDeltaStepping() {
+  Graph graph(12, true);
+  graph.setEdges(gridEdges());
+  graph.DeltaStepping(0, 11, Graph::FindPathMode::SumOfEdges, 2.0, 4).dump();
+  graph.Dijkstra(0, 11, Graph::FindPathMode::SumOfEdges).dump();
+  graph.DeltaStepping(0, 11, Graph::FindPathMode::MaximumEdges, 0, 4).dump();
+}
+
+void testBatchDijkstra() {
+  Graph graph(12, true);
+  graph.setEdges(gridEdges());
+  // the queries from 0 and from 3 share their shortest path trees
+  const std::vector<std::pair<size_t, size_t>> queries{
+      {0, 11}, {0, 9}, {0, 5}, {3, 11}, {3, 0}, {7, 2}};
+  const auto results =
+      graph.BatchDijkstra(queries, Graph::FindPathMode::SumOfEdges, 2);
+  for (size_t i = 0; i < queries.size(); ++i) {
+    const auto single = graph.Dijkstra(queries[i].first, queries[i].second,
+                                       Graph::FindPathMode::SumOfEdges);
+    results[i].dump();
+    single.dump();
+    qDebug() << "Same path as Dijkstra:"
+             << boolToString(results[i].mPathNodes == single.mPathNodes);
+  }
+}
+
+void testMergeTree() {
+  // a 1D double well with a barrier of 3 between the minima at 1 and 5
+  const std::vector<double> values{2, 0, 1, 3, 2, -1, 4};
+  Graph graph(values.size(), false);
+  for (size_t i = 0; i + 1 < values.size(); ++i) {
+    graph.setEdge(i, i + 1);
+  }
+  const MergeTree tree(graph, values);
+  qDebug() << "Number of minima:" << tree.minima().size();
+  qDebug() << "Barrier between 1 and 5:" << tree.barrier(1, 5);
+  qDebug() << "Barrier between 0 and 2:" << tree.barrier(0, 2);
+  qDebug() << "Barrier between 5 and 6:" << tree.barrier(5, 6);
+}
+
+void testLPAStar() {
+  Graph graph(12, true);
+  graph.setEdges(gridEdges());
+  LifelongPlanningAStar lpa(graph, 0, 11, Graph::FindPathMode::SumOfEdges);
+  lpa.computeShortestPath().dump();
+  // block the path through vertex 9 and repair the path
+  lpa.setEdgeWeight(6, 9, 100);
+  lpa.computeShortestPath().dump();
+  graph.setEdge(6, 9, 100);
+  graph.Dijkstra(0, 11, Graph::FindPathMode::SumOfEdges).dump();
+}
+
+void testKShortestPaths() {
+  Graph graph(12, true);
+  graph.setEdges(gridEdges());
+  qDebug() << "The 4 shortest paths:";
+  for (const auto &result : graph.KShortestPaths(
+           0, 11, 4, Graph::FindPathMode::SumOfEdges, 1.0, 100, 2)) {
+    qDebug() << result.mPathNodes;
+  }
+  qDebug() << "The paths sharing at most half of the vertices:";
+  for (const auto &result : graph.KShortestPaths(
+           0, 11, 4, Graph::FindPathMode::SumOfEdges, 0.5, 100, 2)) {
+    qDebug() << result.mPathNodes;
+  }
+}
+
+void testStringMethod() {
+  // double well (x^2 - 1)^2 + y^2, whose minimum energy path is y = 0 with
+  // the barrier 1 at the origin, on a coarse grid
+  std::vector<Axis> axes{Axis(-1.5, 1.5, 15), Axis(-1.5, 1.5, 15)};
+  HistogramScalar<double> pmf(axes);
+  std::function<double(const std::vector<double> &)> f =
+      [](const std::vector<double> &pos) {
+        return (pos[0] * pos[0] - 1) * (pos[0] * pos[0] - 1) +
+               pos[1] * pos[1];
+      };
+  pmf.generate(f);
+  // start from a bent string
+  const std::vector<std::vector<double>> initial{
+      {-1, 0}, {-0.5, 0.6}, {0, 0.8}, {0.5, 0.6}, {1, 0}};
+  const StringMethod string_method(pmf);
+  const auto result = string_method.optimize(initial, 21, 0, 5000, 1e-6, 2);
+  qDebug() << "Converged:" << result.mConverged
+           << "; iterations:" << result.mNumIterations;
+  for (size_t i = 0; i < result.mImages.size(); ++i) {
+    qDebug() << result.mImages[i][0] << result.mImages[i][1]
+             << result.mEnergies[i];
+  }
+}
+
+static void compareMetadynamicsFFT(const std::vector<Axis> &axes,
+                                   bool subgridSpreading, bool onBinCenters,
+                                   double tolerance) {
+  // hills with the same sigmas all over the grid, some of them near the
+  // boundaries
+  std::mt19937 rng(42);
+  const size_t dim = axes.size();
+  const qint64 numHills = 200;
+  std::vector<std::vector<double>> centers(dim, std::vector<double>(numHills));
+  std::vector<std::vector<double>> sigmas(dim, std::vector<double>(numHills));
+  std::vector<double> heights(numHills);
+  for (qint64 i = 0; i < numHills; ++i) {
+    for (size_t j = 0; j < dim; ++j) {
+      const Axis &axis = axes[j];
+      std::uniform_real_distribution<double> position(axis.lowerBound(),
+                                                      axis.upperBound());
+      centers[j][i] = position(rng);
+      if (onBinCenters) {
+        centers[j][i] = axis.lowerBound() +
+                        (std::floor((centers[j][i] - axis.lowerBound()) /
+                                    axis.width()) + 0.5) * axis.width();
+      }
+      sigmas[j][i] = 3.0 * axis.width();
+    }
+    heights[i] = 0.1;
+  }
+  const Metadynamics::HillRef hills(centers, sigmas, heights, numHills);
+  Metadynamics direct(axes, 1);
+  direct.projectHills(hills);
+  Metadynamics fft(axes, 1);
+  fft.setFFT(true, subgridSpreading);
+  fft.projectHills(hills);
+  fft.convolveDeposits();
+  double maxPMF = 0, maxPMFError = 0;
+  for (size_t i = 0; i < direct.PMF().histogramSize(); ++i) {
+    maxPMF = std::max(maxPMF, std::abs(direct.PMF()[i]));
+    maxPMFError = std::max(maxPMFError,
+                           std::abs(direct.PMF()[i] - fft.PMF()[i]));
+  }
+  const auto &directGradients = direct.gradients().data();
+  const auto &fftGradients = fft.gradients().data();
+  double maxGradient = 0, maxGradientError = 0;
+  for (size_t i = 0; i < directGradients.size(); ++i) {
+    maxGradient = std::max(maxGradient, std::abs(directGradients[i]));
+    maxGradientError = std::max(maxGradientError,
+                                std::abs(directGradients[i] - fftGradients[i]));
+  }
+  const double relativePMFError = maxPMFError / maxPMF;
+  const double relativeGradientError = maxGradientError / maxGradient;
+  qDebug() << "Relative error of the PMF:" << relativePMFError
+           << "; gradients:" << relativeGradientError;
+  qDebug() << "FFT agrees with the direct summation:"
+           << boolToString(relativePMFError < tolerance &&
+                           relativeGradientError < tolerance);
+}
+
+void testMetadynamicsFFT() {
+  const std::vector<Axis> periodic{Axis(-180, 180, 72, true),
+                                   Axis(-180, 180, 60, true)};
+  const std::vector<Axis> nonPeriodic{Axis(-5, 5, 40), Axis(-3, 3, 30)};
+  // the hills on the bin centers are summed exactly by both modes, while
+  // the subgrid spreading interpolates the off-center hills linearly
+  // between the bins, and the nearest bin moves them by up to half a bin
+  for (const auto &axes : {periodic, nonPeriodic}) {
+    qDebug() << (axes[0].periodic() ? "Periodic axes:" : "Non-periodic axes:");
+    qDebug() << "Hills on the bin centers:";
+    compareMetadynamicsFFT(axes, false, true, 1e-10);
+    qDebug() << "Off-center hills with the subgrid spreading:";
+    compareMetadynamicsFFT(axes, true, false, 0.05);
+    qDebug() << "Off-center hills on the nearest bins:";
+    compareMetadynamicsFFT(axes, false, false, 0.2);
+  }
+}
+
 void testDivergence(const QString& input_filename, const QString& output_filename) {
   qDebug() << "========== Start testDivergence ==========";
   qDebug() << "Start reading file:" << input_filename;
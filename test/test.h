@@ -20,14 +20,28 @@
 #ifndef TEST_H
 #define TEST_H
 
+#include "base/dynamicpath.h"
 #include "base/graph.h"
+#include "base/mergetree.h"
+#include "base/stringmethod.h"
 #include "base/histogram.h"
 #include "base/integrate_gradients.h"
+#include "base/metadynamics.h"
 
 void testGraph();
 void testDijkstra();
 void testSPFA();
 void testSPFA2();
+void testAStar();
+void testPMFPathFinderAStar();
+void testBidirectionalDijkstra();
+void testDeltaStepping();
+void testBatchDijkstra();
+void testMergeTree();
+void testLPAStar();
+void testKShortestPaths();
+void testStringMethod();
+void testMetadynamicsFFT();
 void testDivergence(const QString& input_filename, const QString& output_filename);
 void testIntegrate(const QString& input_filename, const QString& output_filename);
 